@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Packed asset archive, built from src/ by tools/pack_assets.cpp:
+//   AssetPackHeader, entryCount x AssetPackEntry, then each file's bytes at its offset
+// Offsets are from the start of the file and aligned to ASSET_PACK_ALIGNMENT. Names are the
+// paths the game loads by ("src/enemy.png").
+const uint32_t ASSET_PACK_MAGIC = 0x4b505a4d;  // "MZPK"
+const uint32_t ASSET_PACK_VERSION = 1;
+const size_t ASSET_PACK_ALIGNMENT = 16;
+const size_t ASSET_PACK_NAME_SIZE = 48;
+
+struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct AssetPackEntry {
+    char name[ASSET_PACK_NAME_SIZE];  // NUL-terminated
+    uint64_t offset;
+    uint64_t size;
+};
+
+// MappedFile class
+// A whole file mapped read-only into memory. Implemented in asset_pack.cpp, away from
+// main.cpp, because <windows.h> clashes with raylib (CloseWindow, DrawText, Rectangle...).
+class MappedFile {
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+    void* fileHandle = nullptr;     // Windows only
+    void* mappingHandle = nullptr;  // Windows only
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const char* path);
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
@@ -1,4 +1,5 @@
 #include <raylib.h>
+#include <rlgl.h>
 #include <vector>
 #include <stack>
 #include <cstdlib>
@@ -8,465 +9,4768 @@
 #include <queue>
 #include <iostream>
 #include <fstream> 
+#include <sstream>
 #include <cmath> 
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <memory>
+#include <iterator>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MAZE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Compiles one function for an instruction set beyond the build's baseline. MSVC needs no
+// attribute: it accepts any intrinsic anywhere, and callers check the CPU first.
+#ifdef __GNUC__
+#define MAZE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MAZE_TARGET(isa)
+#endif
+
+#include "asset_pack.h"
+
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#define DRMP3_API static
+#define DR_MP3_IMPLEMENTATION
+#include <dr_mp3.h>
+
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize2.h>
+
+// Reachability index for mazes up to 127x127 cells (255x255 tiles with walls as tiles)
+#define STBCC_GRID_COUNT_X_LOG2 8
+#define STBCC_GRID_COUNT_Y_LOG2 8
+#define STB_CONNECTED_COMPONENTS_IMPLEMENTATION
+#include <stb_connected_components.h>
 
 const int SCREEN_WIDTH = 1200;
 const int SCREEN_HEIGHT = 700;
 const float ENEMY_MOVE_INTERVAL = 1.0f;
+const char* const SAVE_GAME_PATH = "savegame.bin";
+
+// Gameplay advances in fixed ticks, independent of the render frame rate
+const int SIMULATION_TICK_RATE = 60;
+const float SIMULATION_DT = 1.0f / SIMULATION_TICK_RATE;
+const int MAX_TICKS_PER_FRAME = 8;  // after a long stall, drop time instead of spiralling
+const int ENEMY_MOVE_TICKS = (int)(ENEMY_MOVE_INTERVAL * SIMULATION_TICK_RATE + 0.5f);
+
+// Largest maze side: enemy positions are stored as 16-bit numbers
+const int MAX_MAZE_SIZE = 32767;
+
+// Shortest walking distance, in cells, between a fresh enemy and the player
+const int ENEMY_SPAWN_MIN_DISTANCE = 4;
+
+// Ticks after a level starts during which --assert-no-alloc lets buffers grow to size
+const int ALLOCATION_WARMUP_TICKS = 2 * SIMULATION_TICK_RATE;
 
 int highestScore = 0;
 
+// Gameplay random numbers. A fixed generator instead of rand() so that a seed reproduces
+// the same session on every platform, which recorded replays rely on.
+uint64_t gameRandomState = 0x9e3779b97f4a7c15ULL;
 
+void SeedGameRandom(uint32_t seed) {
+    gameRandomState = 0x9e3779b97f4a7c15ULL ^ ((uint64_t)seed * 0xbf58476d1ce4e5b9ULL);
+}
 
-class Enemy;
-class Weapon;
-class Maze;
-class Player;
-class Level;
-class Game;
+// Non-negative, like rand()
+int GameRandom() {
+    // splitmix64
+    uint64_t z = (gameRandomState += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (int)((z ^ (z >> 31)) >> 33);
+}
 
+// Allocation tracking. With MAZE_ALLOC_TRACKING defined, the global operator new and delete
+// are replaced to count heap allocations per thread and in total, profiler scopes record how
+// many happened inside them, and an AllocationGuard turns any allocation on its thread into
+// a recorded violation. Arena blocks come from malloc and are counted explicitly.
+#if defined(MAZE_ALLOC_TRACKING) && !defined(MAZE_PROFILER)
+#error "MAZE_ALLOC_TRACKING attributes allocations to profiler scopes; define MAZE_PROFILER as well"
+#endif
+#ifdef MAZE_ALLOC_TRACKING
+
+struct AllocationCount {
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+};
 
-enum class GameState {
-    FIRST_SCREEN,
-    CHARACTER_SELECTION,
-    LEVEL_SELECTION,
-    PLAYING,
-    GAME_OVER,
-    VICTORY
+thread_local AllocationCount threadAllocations;
+std::atomic<uint64_t> totalAllocationCalls{0};
+std::atomic<uint64_t> totalAllocationBytes{0};
+thread_local const char* activeProfileScope = nullptr;  // innermost open PROFILE_SCOPE, if any
+
+struct AllocationViolation {
+    uint64_t calls = 0;
+    size_t firstBytes = 0;
+    const char* firstScope = nullptr;
 };
 
-// Cell class
-class Cell {
+thread_local int allocationGuardDepth = 0;
+thread_local AllocationViolation allocationViolation;
+
+void CountHeapAllocation(size_t bytes) {
+    threadAllocations.calls++;
+    threadAllocations.bytes += bytes;
+    totalAllocationCalls.fetch_add(1, std::memory_order_relaxed);
+    totalAllocationBytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (allocationGuardDepth > 0 && allocationViolation.calls++ == 0) {
+        allocationViolation.firstBytes = bytes;
+        allocationViolation.firstScope = activeProfileScope;
+    }
+}
+
+void* operator new(std::size_t bytes) {
+    CountHeapAllocation(bytes);
+    void* memory = std::malloc(bytes ? bytes : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](std::size_t bytes) {
+    return operator new(bytes);
+}
+
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept {
+    CountHeapAllocation(bytes);
+    return std::malloc(bytes ? bytes : 1);
+}
+
+void* operator new[](std::size_t bytes, const std::nothrow_t& tag) noexcept {
+    return operator new(bytes, tag);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+
+// AllocationGuard class
+// Forbids heap allocation on the constructing thread while it lives. Violations are only
+// recorded, since reporting from inside operator new could allocate again; read them back
+// once the guarded work is done.
+class AllocationGuard {
 public:
-    bool walls[4] = {true, true, true, true};  // top, right, bottom, left
-    bool visited = false;
+    AllocationGuard() {
+        if (allocationGuardDepth++ == 0) allocationViolation = AllocationViolation();
+    }
+    ~AllocationGuard() { allocationGuardDepth--; }
+    AllocationGuard(const AllocationGuard&) = delete;
+    AllocationGuard& operator=(const AllocationGuard&) = delete;
+
+    const AllocationViolation& violation() const { return allocationViolation; }
 };
 
-// Maze class
-class Maze {
+#else
+
+inline void CountHeapAllocation(size_t) {}
+
+#endif
+
+// Frame profiler. With MAZE_PROFILER defined, PROFILE_SCOPE("name") times the rest of the
+// enclosing block into a ring owned by the calling thread, F3 shows the per-scope
+// statistics of recent frames and F4 starts or stops a trace capture. Without it every
+// PROFILE_ macro expands to nothing.
+#ifdef MAZE_PROFILER
+
+int64_t ProfileNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One finished scope. Names are string literals, so the pointer identifies the scope.
+struct ProfileEvent {
+    const char* name;
+    int64_t startNs;
+    int64_t endNs;
+    uint32_t depth;  // scopes that were open around it on the same thread
+    uint32_t allocationCalls;  // heap allocations while it was open, 0 without MAZE_ALLOC_TRACKING
+    uint64_t allocationBytes;
+};
+
+// ProfileRing class
+// Scopes finished by one thread. Only the owner writes, without locks; the reader takes
+// everything published since its last visit and drops what the owner overwrote meanwhile.
+class ProfileRing {
 private:
-    int width, height;
-    int cellSize;
-    std::vector<std::vector<Cell>> grid;
-    Texture2D startTexture;
-    Texture2D endTexture;
-    int offsetX, offsetY;
-    Texture2D mazeBackground;
+    static const uint64_t CAPACITY = 8192;  // power of two
+
+    // The reader can copy a slot while the owner is overwriting it, so every field is a
+    // relaxed atomic: the copy may be torn but is never a data race, and drain() throws
+    // torn copies away
+    struct Slot {
+        std::atomic<const char*> name;
+        std::atomic<int64_t> startNs;
+        std::atomic<int64_t> endNs;
+        std::atomic<uint32_t> depth;
+        std::atomic<uint32_t> allocationCalls;
+        std::atomic<uint64_t> allocationBytes;
+    };
 
+    Slot slots[CAPACITY];
+    std::atomic<uint64_t> head{0};  // events ever pushed
+    uint64_t readCursor = 0;
 
 public:
-    Maze(int w, int h, int cSize) : width(w), height(h), cellSize(cSize) {
-        grid.resize(height, std::vector<Cell>(width));
-        offsetX = (SCREEN_WIDTH - width * cellSize) / 2;
-        offsetY = (SCREEN_HEIGHT - height * cellSize) / 2;
+    std::atomic<bool> inUse{false};
+    uint32_t threadIndex = 0;
+    const char* threadName = nullptr;  // shown in traces
+    uint32_t depth = 0;  // owner only
+
+    void push(const ProfileEvent& event) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (CAPACITY - 1)];
+        // Pairs with the fence in drain(): a reader that sees any of these stores also sees
+        // the head that says this slot is being reused
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(event.name, std::memory_order_relaxed);
+        slot.startNs.store(event.startNs, std::memory_order_relaxed);
+        slot.endNs.store(event.endNs, std::memory_order_relaxed);
+        slot.depth.store(event.depth, std::memory_order_relaxed);
+        slot.allocationCalls.store(event.allocationCalls, std::memory_order_relaxed);
+        slot.allocationBytes.store(event.allocationBytes, std::memory_order_relaxed);
+        head.store(index + 1, std::memory_order_release);
     }
 
-    void loadTextures(Texture2D start, Texture2D end) {
-        startTexture = start;
-        endTexture = end;
+    template <typename Visit>
+    void drain(Visit visit) {
+        uint64_t end = head.load(std::memory_order_acquire);
+        if (end - readCursor > CAPACITY) readCursor = end - CAPACITY;
+        for (; readCursor < end; ++readCursor) {
+            const Slot& slot = slots[readCursor & (CAPACITY - 1)];
+            ProfileEvent event;
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.startNs = slot.startNs.load(std::memory_order_relaxed);
+            event.endNs = slot.endNs.load(std::memory_order_relaxed);
+            event.depth = slot.depth.load(std::memory_order_relaxed);
+            event.allocationCalls = slot.allocationCalls.load(std::memory_order_relaxed);
+            event.allocationBytes = slot.allocationBytes.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Once head reaches readCursor + CAPACITY the owner may be rewriting this slot
+            if (head.load(std::memory_order_relaxed) - readCursor >= CAPACITY) continue;
+            visit(event);
+        }
     }
+};
 
-    void generate() {
-        std::stack<std::pair<int, int>> stack;
-        stack.push({0, 0});
-        grid[0][0].visited = true;
-
-        while (!stack.empty()) {
-            std::pair<int, int> top = stack.top();
-            int x = top.first;
-            int y = top.second;
-            std::vector<int> neighbors;
-
-            if (y > 0 && !grid[y-1][x].visited) neighbors.push_back(0);
-            if (x < width-1 && !grid[y][x+1].visited) neighbors.push_back(1);
-            if (y < height-1 && !grid[y+1][x].visited) neighbors.push_back(2);
-            if (x > 0 && !grid[y][x-1].visited) neighbors.push_back(3);
-
-            if (!neighbors.empty()) {
-                int next = neighbors[rand() % neighbors.size()];
-                int nx = x + (next == 1 ? 1 : (next == 3 ? -1 : 0));
-                int ny = y + (next == 2 ? 1 : (next == 0 ? -1 : 0));
-
-                grid[y][x].walls[next] = false;
-                grid[ny][nx].walls[(next + 2) % 4] = false;
-                grid[ny][nx].visited = true;
-                stack.push({nx, ny});
-            } else {
-                stack.pop();
-            }
+// Profiler class
+// Hands each thread a ring on its first scope. A thread's ring goes back to the pool when the
+// thread ends, so restarting the simulation thread every level does not grow the list.
+class Profiler {
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileRing>> rings;
+
+    struct ThreadSlot {
+        ProfileRing* ring = nullptr;
+        ~ThreadSlot() {
+            if (ring) ring->inUse.store(false, std::memory_order_release);
         }
+    };
 
-        // Randomly remove some walls
-        for (int i = 0; i < width * height / 10; ++i) {
-            int x = rand() % width;
-            int y = rand() % height;
-            int wall = rand() % 4;
-            if (grid[y][x].walls[wall]) {
-                grid[y][x].walls[wall] = false;
-                int nx = x + (wall == 1 ? 1 : (wall == 3 ? -1 : 0));
-                int ny = y + (wall == 2 ? 1 : (wall == 0 ? -1 : 0));
-                if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                    grid[ny][nx].walls[(wall + 2) % 4] = false;
-                }
+    ProfileRing* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& ring : rings) {
+            bool idle = false;
+            if (ring->inUse.compare_exchange_strong(idle, true)) return ring.get();
+        }
+        rings.push_back(std::make_unique<ProfileRing>());
+        rings.back()->threadIndex = (uint32_t)rings.size() - 1;
+        rings.back()->threadName = rings.size() == 1 ? "main" : nullptr;
+        rings.back()->inUse = true;
+        return rings.back().get();
+    }
+
+public:
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    ProfileRing& threadRing() {
+        static thread_local ThreadSlot slot;
+        if (!slot.ring) slot.ring = acquire();
+        return *slot.ring;
+    }
+
+    // Names of the threads that own, or last owned, each ring
+    std::vector<const char*> threadNames() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<const char*> names;
+        for (auto& ring : rings) names.push_back(ring->threadName);
+        return names;
+    }
+
+    template <typename Visit>
+    void drain(Visit visit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& ring : rings) {
+            uint32_t thread = ring->threadIndex;
+            ring->drain([&](const ProfileEvent& event) { visit(thread, event); });
+        }
+    }
+};
+
+// ProfileScope class
+class ProfileScope {
+private:
+    ProfileRing& ring;
+    const char* name;
+    int64_t startNs;
+#ifdef MAZE_ALLOC_TRACKING
+    const char* parent;
+    AllocationCount allocationsAtStart;
+#endif
+
+public:
+    explicit ProfileScope(const char* scopeName)
+        : ring(Profiler::instance().threadRing()), name(scopeName), startNs(ProfileNowNs()) {
+        ring.depth++;
+#ifdef MAZE_ALLOC_TRACKING
+        parent = activeProfileScope;
+        activeProfileScope = name;
+        allocationsAtStart = threadAllocations;
+#endif
+    }
+
+    ~ProfileScope() {
+        ring.depth--;
+        ProfileEvent event = {name, startNs, ProfileNowNs(), ring.depth, 0, 0};
+#ifdef MAZE_ALLOC_TRACKING
+        event.allocationCalls = (uint32_t)(threadAllocations.calls - allocationsAtStart.calls);
+        event.allocationBytes = threadAllocations.bytes - allocationsAtStart.bytes;
+        activeProfileScope = parent;
+#endif
+        ring.push(event);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// raylib draw calls issued by the render thread this frame. rlgl batches them and does not
+// report how many batches reach the GPU, so this counts submissions.
+uint32_t profileDrawCalls = 0;
+
+// TraceRecorder class
+// While a capture runs, keeps every drained scope plus counter samples, and when it stops
+// writes them as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev) on a worker
+// thread, so ending a capture never stalls a frame on formatting or disk.
+class TraceRecorder {
+private:
+    // Slices and counter samples are capped separately: 4M of each, at 48 and 24 bytes, is about 300 MB,
+    // more for a moment while a buffer grows. Later events are dropped.
+    static const size_t MAX_EVENTS = 4 << 20;
+
+    struct Slice {
+        const char* name;
+        uint32_t thread;
+        int64_t startNs;
+        int64_t endNs;
+        uint32_t allocationCalls;
+        uint64_t allocationBytes;
+    };
+
+    struct CounterSample {
+        const char* name;
+        int64_t ns;
+        double value;
+    };
+
+    struct Capture {
+        std::string path;
+        int64_t originNs = 0;
+        std::vector<Slice> slices;
+        std::vector<CounterSample> counters;
+        std::vector<const char*> threadNames;
+    };
+
+    Capture capture;
+    bool capturing = false;
+    std::thread writer;
+
+    static void writeJson(const Capture& capture) {
+        std::string temporaryPath = capture.path + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Could not write trace " << temporaryPath << std::endl;
+            return;
+        }
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (size_t i = 0; i < capture.threadNames.size(); ++i) {
+            const char* name = capture.threadNames[i] ? capture.threadNames[i] : "thread";
+            fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}},\n", i, name);
+        }
+        for (const Slice& slice : capture.slices) {
+            fprintf(file, "{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f", slice.thread, slice.name,
+                    (slice.startNs - capture.originNs) / 1e3, (slice.endNs - slice.startNs) / 1e3);
+            if (slice.allocationCalls > 0) {
+                fprintf(file, ",\"args\":{\"allocations\":%u,\"bytes\":%llu}", slice.allocationCalls,
+                        (unsigned long long)slice.allocationBytes);
             }
+            fprintf(file, "},\n");
         }
+        for (const CounterSample& sample : capture.counters) {
+            fprintf(file, "{\"ph\":\"C\",\"pid\":1,\"name\":\"%s\",\"ts\":%.3f,\"args\":{\"value\":%g}},\n", sample.name,
+                    (sample.ns - capture.originNs) / 1e3, sample.value);
+        }
+        fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"Star Wars Maze\"}}\n]}\n");
+        bool written = ferror(file) == 0;
+        written = fclose(file) == 0 && written;
+
+        std::error_code error;
+        if (written) std::filesystem::rename(temporaryPath, capture.path, error);
+        if (!written || error) {
+            std::cerr << "Could not write trace " << capture.path << std::endl;
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+        std::cout << "Wrote trace " << capture.path << " (" << capture.slices.size() << " scopes)" << std::endl;
+    }
 
-        // After generating the maze and removing some walls, close the border
-        closeBorderWalls();
+public:
+    static TraceRecorder& instance() {
+        static TraceRecorder recorder;
+        return recorder;
     }
 
-    void closeBorderWalls() {
-        // Close top and bottom walls
-        for (int x = 0; x < width; ++x) {
-            grid[0][x].walls[0] = true;  // Top wall
-            grid[height-1][x].walls[2] = true;  // Bottom wall
+    ~TraceRecorder() {
+        stop();
+        if (writer.joinable()) writer.join();
+    }
+
+    bool active() const { return capturing; }
+
+    void start(const std::string& path) {
+        if (capturing) return;
+        if (writer.joinable()) writer.join();  // the previous capture's file is still being written
+        capture = Capture();
+        capture.path = path;
+        capture.originNs = ProfileNowNs();
+        capturing = true;
+    }
+
+    // Hands the capture to the writer thread
+    void stop() {
+        if (!capturing) return;
+        capturing = false;
+        capture.threadNames = Profiler::instance().threadNames();
+        writer = std::thread(&TraceRecorder::writeJson, std::move(capture));
+    }
+
+    void toggle(const std::string& path) {
+        if (capturing) {
+            stop();
+        } else {
+            start(path);
         }
-        // Close left and right walls
-        for (int y = 0; y < height; ++y) {
-            grid[y][0].walls[3] = true;  // Left wall
-            grid[y][width-1].walls[1] = true;  // Right wall
+    }
+
+    void addSlice(uint32_t thread, const ProfileEvent& event) {
+        if (capturing && capture.slices.size() < MAX_EVENTS && event.startNs >= capture.originNs) {
+            capture.slices.push_back({event.name, thread, event.startNs, event.endNs, event.allocationCalls, event.allocationBytes});
         }
     }
 
-    void draw() const {
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                int screenX = x * cellSize + offsetX;
-                int screenY = y * cellSize + offsetY;
-                if (grid[y][x].walls[0]) DrawLine(screenX, screenY, screenX + cellSize, screenY, WHITE);
-                if (grid[y][x].walls[1]) DrawLine(screenX + cellSize, screenY, screenX + cellSize, screenY + cellSize, WHITE);
-                if (grid[y][x].walls[2]) DrawLine(screenX, screenY + cellSize, screenX + cellSize, screenY + cellSize, WHITE);
-                if (grid[y][x].walls[3]) DrawLine(screenX, screenY, screenX, screenY + cellSize, WHITE);
-            }
+    void addCounter(const char* name, double value) {
+        if (capturing && capture.counters.size() < MAX_EVENTS) capture.counters.push_back({name, ProfileNowNs(), value});
+    }
+};
+
+// ProfileOverlay class
+// Folds drained scopes into per-frame totals and keeps the last WINDOW frames of each scope
+// for the overlay: mean and 99th percentile time per frame, calls per frame and, with
+// allocation tracking, heap allocations per frame made inside the scope.
+class ProfileOverlay {
+private:
+    static constexpr int WINDOW = 240;
+
+    struct Scope {
+        const char* name;
+        uint32_t thread;
+        uint32_t depth;
+        int64_t frameNs = 0;
+        uint32_t frameCalls = 0;
+        uint32_t frameAllocations = 0;
+        float ms[WINDOW] = {};
+        uint32_t calls[WINDOW] = {};
+        uint32_t allocations[WINDOW] = {};
+    };
+
+    std::vector<Scope> scopes;  // in order of first appearance
+    uint32_t drawCalls[WINDOW] = {};
+    uint32_t frameAllocations[WINDOW] = {};  // all threads, scoped or not
+    uint64_t allocationCallsSeen = 0;
+    int frameIndex = 0;
+    int framesRecorded = 0;
+    bool visible = false;
+    std::vector<float> sortScratch;
+
+    Scope& scopeFor(uint32_t thread, const ProfileEvent& event) {
+        for (Scope& scope : scopes) {
+            if (scope.name == event.name && scope.thread == thread) return scope;
         }
+        scopes.emplace_back();
+        scopes.back().name = event.name;
+        scopes.back().thread = thread;
+        scopes.back().depth = event.depth;
+        return scopes.back();
+    }
 
-        // Draw start and end images
-        float startScale = (float)(cellSize * 0.8) / std::max(startTexture.width, startTexture.height);
-        float endScale = (float)(cellSize * 0.8) / std::max(endTexture.width, endTexture.height);
-        
-        float startX = offsetX + (cellSize - startTexture.width * startScale) / 2;
-        float startY = offsetY + (cellSize - startTexture.height * startScale) / 2;
-        float endX = offsetX + (width - 1) * cellSize + (cellSize - endTexture.width * endScale) / 2;
-        float endY = offsetY + (height - 1) * cellSize + (cellSize - endTexture.height * endScale) / 2;
-        
-        DrawTextureEx(startTexture, {startX, startY}, 0, startScale, WHITE);
-        DrawTextureEx(endTexture, {endX, endY}, 0, endScale, WHITE);
+    float percentile99(const float* samples) {
+        sortScratch.assign(samples, samples + WINDOW);
+        sortScratch.resize(framesRecorded);
+        size_t rank = std::min(sortScratch.size() - 1, sortScratch.size() * 99 / 100);
+        std::nth_element(sortScratch.begin(), sortScratch.begin() + rank, sortScratch.end());
+        return sortScratch[rank];
     }
 
-    bool canMove(int x, int y, int direction) const {
-        return !grid[y][x].walls[direction];
+public:
+    static ProfileOverlay& instance() {
+        static ProfileOverlay overlay;
+        return overlay;
     }
 
-    int getWidth() const { return width; }
-    int getHeight() const { return height; }
-    int getCellSize() const { return cellSize; }
-    int getOffsetX() const { return offsetX; }
-    int getOffsetY() const { return offsetY; }
+    void endFrame() {
+        TraceRecorder& trace = TraceRecorder::instance();
+        Profiler::instance().drain([&](uint32_t thread, const ProfileEvent& event) {
+            trace.addSlice(thread, event);
+            Scope& scope = scopeFor(thread, event);
+            scope.frameNs += event.endNs - event.startNs;
+            scope.frameCalls++;
+            scope.frameAllocations += event.allocationCalls;
+        });
+        for (Scope& scope : scopes) {
+            scope.ms[frameIndex] = scope.frameNs / 1e6f;
+            scope.calls[frameIndex] = scope.frameCalls;
+            scope.allocations[frameIndex] = scope.frameAllocations;
+            scope.frameNs = 0;
+            scope.frameCalls = 0;
+            scope.frameAllocations = 0;
+        }
+        drawCalls[frameIndex] = profileDrawCalls;
+        trace.addCounter("draw calls", profileDrawCalls);
+        profileDrawCalls = 0;
+#ifdef MAZE_ALLOC_TRACKING
+        uint64_t allocationCalls = totalAllocationCalls.load(std::memory_order_relaxed);
+        frameAllocations[frameIndex] = (uint32_t)(allocationCalls - allocationCallsSeen);
+        allocationCallsSeen = allocationCalls;
+        trace.addCounter("allocations", frameAllocations[frameIndex]);
+#endif
+        frameIndex = (frameIndex + 1) % WINDOW;
+        framesRecorded = std::min(framesRecorded + 1, WINDOW);
+    }
 
-    std::vector<std::pair<int, int>> findPath(int startX, int startY, int endX, int endY) const {
-        std::vector<std::vector<bool>> visited(height, std::vector<bool>(width, false));
-        std::vector<std::vector<std::pair<int, int>>> parent(height, std::vector<std::pair<int, int>>(width, {-1, -1}));
-        std::queue<std::pair<int, int>> q;
-    
-        q.push({startX, startY});
-        visited[startY][startX] = true;
-    
-        const int dx[] = {0, 1, 0, -1};
-        const int dy[] = {-1, 0, 1, 0};
-    
-        while (!q.empty()) {
-            std::pair<int, int> front = q.front();
-            int x = front.first;
-            int y = front.second;
-            q.pop();
-        
-            if (x == endX && y == endY) {
-                return reconstructPath(parent, startX, startY, endX, endY);
-            }
-        
-            for (int i = 0; i < 4; ++i) {
-                int nx = x + dx[i];
-                int ny = y + dy[i];
-            
-                if (nx >= 0 && nx < width && ny >= 0 && ny < height && !visited[ny][nx] && canMove(x, y, i)) {
-                    visited[ny][nx] = true;
-                    parent[ny][nx] = {x, y};
-                    q.push({nx, ny});
-                }
+    void draw() {
+        if (IsKeyPressed(KEY_F3)) visible = !visible;
+        if (!visible || framesRecorded == 0) return;
+
+        const int rowHeight = 14;
+        const int width = 440;
+        int x = SCREEN_WIDTH - width - 10;
+        int y = 60;
+        DrawRectangle(x - 6, y - 6, width + 12, (int)(scopes.size() + 2) * rowHeight + 12, Fade(BLACK, 0.75f));
+        DrawText("scope", x, y, 10, YELLOW);
+        DrawText("mean ms", x + 220, y, 10, YELLOW);
+        DrawText("p99 ms", x + 290, y, 10, YELLOW);
+        DrawText("calls", x + 360, y, 10, YELLOW);
+#ifdef MAZE_ALLOC_TRACKING
+        DrawText("allocs", x + 400, y, 10, YELLOW);
+#endif
+        y += rowHeight;
+        uint32_t ownThread = Profiler::instance().threadRing().threadIndex;
+        for (const Scope& scope : scopes) {
+            float total = 0;
+            uint64_t calls = 0, allocations = 0;
+            for (int i = 0; i < framesRecorded; ++i) {
+                total += scope.ms[i];
+                calls += scope.calls[i];
+                allocations += scope.allocations[i];
             }
+            const char* label = scope.thread == ownThread ? scope.name : TextFormat("%s [thread %u]", scope.name, scope.thread);
+            DrawText(label, x + 10 * (int)scope.depth, y, 10, WHITE);
+            DrawText(TextFormat("%7.3f", total / framesRecorded), x + 220, y, 10, WHITE);
+            DrawText(TextFormat("%7.3f", percentile99(scope.ms)), x + 290, y, 10, WHITE);
+            DrawText(TextFormat("%.1f", (double)calls / framesRecorded), x + 360, y, 10, WHITE);
+#ifdef MAZE_ALLOC_TRACKING
+            DrawText(TextFormat("%.1f", (double)allocations / framesRecorded), x + 400, y, 10, allocations ? ORANGE : WHITE);
+#endif
+            y += rowHeight;
         }
-    
-        return {};  // No path found
+        uint64_t draws = 0, allocations = 0;
+        for (int i = 0; i < framesRecorded; ++i) {
+            draws += drawCalls[i];
+            allocations += frameAllocations[i];
+        }
+        DrawText(TextFormat("draw calls/frame %.0f  allocs/frame %.1f  over %d frames", (double)draws / framesRecorded,
+                            (double)allocations / framesRecorded, framesRecorded), x, y, 10, YELLOW);
     }
+};
 
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_DRAWS(count) (profileDrawCalls += (uint32_t)(count))
+#define PROFILE_END_FRAME() ProfileOverlay::instance().endFrame()
+#define PROFILE_DRAW_OVERLAY() ProfileOverlay::instance().draw()
+#define PROFILE_THREAD_NAME(name) (Profiler::instance().threadRing().threadName = (name))
+#define PROFILE_COUNTER(name, value) TraceRecorder::instance().addCounter(name, (double)(value))
+#define PROFILE_TRACE_BEGIN(path) TraceRecorder::instance().start(path)
+#define PROFILE_TRACE_END() TraceRecorder::instance().stop()
+#define PROFILE_TRACE_TOGGLE(path) TraceRecorder::instance().toggle(path)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_DRAWS(count) ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#define PROFILE_DRAW_OVERLAY() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_TRACE_BEGIN(path) ((void)0)
+#define PROFILE_TRACE_END() ((void)0)
+#define PROFILE_TRACE_TOGGLE(path) ((void)0)
+
+#endif
+
+// StateWriter class
+// Appends plain values to a byte buffer for state snapshots, keyframes and replay files
+class StateWriter {
 private:
-    std::vector<std::pair<int, int>> reconstructPath(const std::vector<std::vector<std::pair<int, int>>>& parent,
-                                                     int startX, int startY, int endX, int endY) const {
-        std::vector<std::pair<int, int>> path;
-        int x = endX, y = endY;
-    
-        while (x != startX || y != startY) {
-            path.push_back({x, y});
-            std::pair<int, int> p = parent[y][x];
-            x = p.first;
-            y = p.second;
+    std::vector<uint8_t>& out;
+
+public:
+    explicit StateWriter(std::vector<uint8_t>& buffer) : out(buffer) {}
+
+    template <typename T>
+    void put(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T, typename Allocator>
+    void putArray(const std::vector<T, Allocator>& values) {
+        put((uint32_t)values.size());
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    void putBytes(const uint8_t* bytes, size_t count) {
+        out.insert(out.end(), bytes, bytes + count);
+    }
+
+    // LEB128, for numbers that are usually tiny
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
         }
-    
-        path.push_back({startX, startY});
-        std::reverse(path.begin(), path.end());
-        return path;
+        out.push_back((uint8_t)value);
     }
+};
+
+// StateReader class
+// Reads back what StateWriter wrote; every read fails softly once the data runs out
+class StateReader {
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+    bool valid;
 
 public:
-    void drawPath(const std::vector<std::pair<int, int>>& path) const {
-        if (path.empty()) return;
-
-        for (size_t i = 0; i < path.size() - 1; ++i) {
-            std::pair<int, int> p1 = path[i];
-            std::pair<int, int> p2 = path[i + 1];
-            int x1 = p1.first;
-            int y1 = p1.second;
-            int x2 = p2.first;
-            int y2 = p2.second;
-        
-            float startX = x1 * cellSize + cellSize / 2 + offsetX;
-            float startY = y1 * cellSize + cellSize / 2 + offsetY;
-            float endX = x2 * cellSize + cellSize / 2 + offsetX;
-            float endY = y2 * cellSize + cellSize / 2 + offsetY;
-        
-            DrawLineEx({startX, startY}, {endX, endY}, 3, YELLOW);
+    StateReader(const uint8_t* bytes, size_t length) : data(bytes), size(length), offset(0), valid(true) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (!valid || size - offset < sizeof(T)) return valid = false;
+        std::copy_n(data + offset, sizeof(T), reinterpret_cast<uint8_t*>(&value));
+        offset += sizeof(T);
+        return true;
+    }
+
+    template <typename T, typename Allocator>
+    bool getArray(std::vector<T, Allocator>& values) {
+        uint32_t count = 0;
+        if (!get(count) || (size - offset) / sizeof(T) < count) return valid = false;
+        values.resize(count);
+        std::copy_n(data + offset, count * sizeof(T), reinterpret_cast<uint8_t*>(values.data()));
+        offset += count * sizeof(T);
+        return true;
+    }
+
+    bool getBytes(uint8_t* bytes, size_t count) {
+        if (!valid || size - offset < count) return valid = false;
+        std::copy_n(data + offset, count, bytes);
+        offset += count;
+        return true;
+    }
+
+    bool getVarint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!get(byte)) return false;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
         }
+        return valid = false;
     }
+
+    bool ok() const { return valid; }
+    bool atEnd() const { return offset == size; }
 };
 
-// Player class
-class Player {
+// FNV-1a, used to fingerprint serialized game states
+uint64_t HashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Arena class
+// Bump allocator for memory that is released all at once. Blocks survive reset(), so once an
+// arena has grown to its working size, filling it again makes no system allocations.
+// Destructors of objects placed here are never run, so they must only own arena memory.
+class Arena {
 private:
-    int x, y;
-    int power;
-    int score;
-    int weaponsCollected;
-    Texture2D texture;
-    const Maze* maze;
-    std::vector<std::pair<int, int>> currentPath; // Added member variable
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0;  // block being filled
+    size_t used = 0;     // bytes taken from it
+    size_t minimumBlockSize;
 
 public:
-    Player(int startX, int startY, Texture2D playerTexture, const Maze* m, int initialScore = 0) 
-    : x(startX), y(startY), power(20), score(initialScore), weaponsCollected(2), texture(playerTexture), maze(m) {}
+    explicit Arena(size_t blockSize = 64 * 1024) : minimumBlockSize(blockSize) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
 
-    void move(int dx, int dy) {
-        x += dx;
-        y += dy;
+    ~Arena() {
+        for (Block& block : blocks) std::free(block.data);
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        while (current < blocks.size()) {
+            Block& block = blocks[current];
+            uintptr_t base = (uintptr_t)block.data;
+            size_t offset = ((base + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+            if (offset + bytes <= block.size) {
+                used = offset + bytes;
+                return block.data + offset;
+            }
+            current++;
+            used = 0;
+        }
+        // Each new block is at least as big as all the others, so a level needs only a few
+        size_t size = std::max(std::max(minimumBlockSize, capacity()), bytes + alignment);
+        uint8_t* data = static_cast<uint8_t*>(std::malloc(size));
+        if (!data) throw std::bad_alloc();
+        CountHeapAllocation(size);
+        blocks.push_back({data, size});
+        return allocate(bytes, alignment);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Releases everything in O(1); the blocks are kept for the next fill
+    void reset() {
+        current = 0;
+        used = 0;
+    }
+
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block& block : blocks) total += block.size;
+        return total;
+    }
+};
+
+// Lets standard containers take their storage from an Arena; freeing is a no-op
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    Arena* arena;
+
+    explicit ArenaAllocator(Arena& owner) : arena(&owner) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// SnapshotHistory class
+// The last few seconds of SaveState blobs, for rewind and rollback. Only the newest state is
+// kept whole; every older tick is a reverse delta, the XOR against the state one tick later
+// with unchanged stretches skipped, so a quiet tick costs a handful of bytes. Deltas are
+// packed into one fixed byte ring and the oldest are dropped when it fills, so capturing
+// does not allocate once the buffers have reached the size of a state.
+class SnapshotHistory {
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+    };
+
+    std::vector<uint8_t> latest;
+    std::vector<uint8_t> ring;     // delta bytes
+    std::vector<Entry> entries;    // ring of deltas; each turns the next newer state into its own
+    std::vector<uint8_t> encoded;  // delta being built
+    size_t first;                  // oldest entry
+    size_t count;
+    size_t writeOffset;
+    bool hasLatest;
+
+    static uint8_t byteAt(const std::vector<uint8_t>& bytes, size_t i) {
+        return i < bytes.size() ? bytes[i] : 0;
+    }
+
+    // Encodes 'older' relative to 'newer' as: older size, then (skip, length, XOR bytes) runs
+    static void encode(const std::vector<uint8_t>& newer, const std::vector<uint8_t>& older, std::vector<uint8_t>& delta) {
+        const size_t MIN_SKIP = 4;  // shorter equal stretches stay inside a run
+        delta.clear();
+        StateWriter out(delta);
+        out.putVarint(older.size());
+        size_t n = std::max(newer.size(), older.size());
+        size_t i = 0;
+        while (i < n) {
+            size_t start = i;
+            while (start < n && byteAt(newer, start) == byteAt(older, start)) start++;
+            if (start == n) break;
+            size_t end = start;
+            while (end < n) {
+                size_t same = end;
+                while (same < n && same - end < MIN_SKIP && byteAt(newer, same) == byteAt(older, same)) same++;
+                if (same == n || same - end >= MIN_SKIP) break;
+                end = same + 1;
+            }
+            out.putVarint(start - i);
+            out.putVarint(end - start);
+            for (size_t k = start; k < end; ++k) delta.push_back(byteAt(newer, k) ^ byteAt(older, k));
+            i = end;
+        }
+    }
+
+    static void apply(std::vector<uint8_t>& state, const uint8_t* delta, size_t size) {
+        StateReader in(delta, size);
+        uint64_t olderSize = 0;
+        in.getVarint(olderSize);
+        state.resize(std::max<size_t>(state.size(), olderSize), 0);
+        size_t pos = 0;
+        while (!in.atEnd() && in.ok()) {
+            uint64_t skip = 0, length = 0;
+            in.getVarint(skip);
+            in.getVarint(length);
+            pos += skip;
+            for (uint64_t k = 0; k < length && pos < state.size(); ++k) {
+                uint8_t bits = 0;
+                in.get(bits);
+                state[pos++] ^= bits;
+            }
+        }
+        state.resize(olderSize);
+    }
+
+    static bool overlaps(const Entry& entry, size_t start, size_t end) {
+        return entry.offset < end && start < entry.offset + entry.size;
+    }
+
+public:
+    explicit SnapshotHistory(size_t ticks = 0, size_t bytes = 64 * 1024)
+        : ring(ticks ? bytes : 0), entries(ticks), first(0), count(0), writeOffset(0), hasLatest(false) {}
+
+    void clear() {
+        first = 0;
+        count = 0;
+        writeOffset = 0;
+        hasLatest = false;
+        latest.clear();  // serialize() writes it, so a cleared history must not keep the old state
+    }
+
+    // Records the state after a tick; the previous newest becomes a delta
+    void push(const std::vector<uint8_t>& state) {
+        if (hasLatest && !entries.empty()) {
+            encode(state, latest, encoded);
+            if (encoded.size() > ring.size()) {
+                // Cannot happen at the default size; start over with room for it
+                ring.resize(encoded.size() * 2);
+                count = 0;
+                writeOffset = 0;
+            }
+            bool wrap = writeOffset + encoded.size() > ring.size();
+            size_t start = wrap ? 0 : writeOffset;
+            // The oldest deltas sit right after the write position; drop those in the way
+            while (count > 0) {
+                const Entry& oldest = entries[first];
+                bool inTheWay = overlaps(oldest, start, start + encoded.size()) ||
+                                (wrap && overlaps(oldest, writeOffset, ring.size()));
+                if (!inTheWay && count < entries.size()) break;
+                first = (first + 1) % entries.size();
+                count--;
+            }
+            std::copy(encoded.begin(), encoded.end(), ring.begin() + start);
+            entries[(first + count) % entries.size()] = {start, encoded.size()};
+            count++;
+            writeOffset = start + encoded.size();
+        }
+        latest = state;
+        hasLatest = true;
+    }
+
+    // Drops the newest state so the one a tick older becomes current
+    bool stepBack() {
+        if (count == 0) return false;
+        const Entry& newest = entries[(first + count - 1) % entries.size()];
+        apply(latest, ring.data() + newest.offset, newest.size);
+        writeOffset = newest.offset;
+        count--;
+        return true;
+    }
+
+    // Goes back up to 'ticks' states and returns how many it went
+    size_t rewind(size_t ticks) {
+        size_t stepped = 0;
+        while (stepped < ticks && stepBack()) stepped++;
+        return stepped;
+    }
+
+    bool empty() const { return !hasLatest; }
+    size_t depth() const { return count; }  // ticks that can be stepped back
+    const std::vector<uint8_t>& current() const { return latest; }
+
+    size_t storedBytes() const {
+        size_t total = latest.size();
+        for (size_t i = 0; i < count; ++i) total += entries[(first + i) % entries.size()].size;
+        return total;
+    }
+
+    // Sizes the working buffers for states up to 'stateBytes', so pushing and stepping back
+    // through them allocates nothing. A delta's runs are at least MIN_SKIP apart, which
+    // bounds its varints.
+    void reserve(size_t stateBytes) {
+        const size_t VARINT_BYTES = 10;
+        latest.reserve(stateBytes);
+        encoded.reserve(stateBytes + VARINT_BYTES * (1 + 2 * (stateBytes / 5 + 1)));
+    }
+
+    // Most serialize() can write while states stay within 'stateBytes'
+    size_t serializedBound(size_t stateBytes) const {
+        const size_t VARINT_BYTES = 10;
+        return 5 * VARINT_BYTES + 1 + sizeof(uint32_t) + stateBytes + ring.size() + entries.size() * 2 * VARINT_BYTES;
+    }
+
+    // Everything later pushes and steps depend on, including where each delta sits in the
+    // ring, since that decides what gets dropped. Only live deltas are written.
+    void serialize(StateWriter& out) const {
+        out.putVarint(ring.size());
+        out.putVarint(entries.size());
+        out.putVarint(writeOffset);
+        out.put((uint8_t)hasLatest);
+        out.putArray(latest);
+        out.putVarint(count);
+        for (size_t i = 0; i < count; ++i) {
+            const Entry& entry = entries[(first + i) % entries.size()];
+            out.putVarint(entry.offset);
+            out.putVarint(entry.size);
+            out.putBytes(ring.data() + entry.offset, entry.size);
+        }
+    }
+
+    // Returns false on malformed input
+    bool deserialize(StateReader& in) {
+        uint64_t ringSize = 0, capacity = 0, offset = 0, live = 0;
+        uint8_t latestValid = 0;
+        if (!in.getVarint(ringSize) || !in.getVarint(capacity) || !in.getVarint(offset) || !in.get(latestValid) ||
+            !in.getArray(latest) || !in.getVarint(live) || live > capacity || offset > ringSize) {
+            return false;
+        }
+        ring.assign(ringSize, 0);
+        entries.assign(capacity, Entry{0, 0});
+        first = 0;
+        count = 0;
+        writeOffset = offset;
+        hasLatest = latestValid != 0;
+        for (uint64_t i = 0; i < live; ++i) {
+            uint64_t entryOffset = 0, entrySize = 0;
+            if (!in.getVarint(entryOffset) || !in.getVarint(entrySize) || entryOffset > ringSize ||
+                entrySize > ringSize - entryOffset || !in.getBytes(ring.data() + entryOffset, entrySize)) {
+                return false;
+            }
+            entries[count++] = {entryOffset, entrySize};
+        }
+        return true;
     }
+};
+
+
+
+class EnemySwarm;
+class Weapon;
+class Maze;
+class Player;
+class Level;
+class Game;
+
+
+// Gameplay keys pressed since the last simulation tick, as a bit set
+enum PlayingInput : uint32_t {
+    INPUT_UP = 1 << 0,
+    INPUT_RIGHT = 1 << 1,
+    INPUT_DOWN = 1 << 2,
+    INPUT_LEFT = 1 << 3,
+    INPUT_TOGGLE_PATH = 1 << 4,
+    INPUT_EXIT_TO_MENU = 1 << 5,
+    INPUT_REWIND = 1 << 6
+};
+
+uint32_t ReadPlayingKeys() {
+    uint32_t input = 0;
+    if (IsKeyPressed(KEY_UP)) input |= INPUT_UP;
+    if (IsKeyPressed(KEY_RIGHT)) input |= INPUT_RIGHT;
+    if (IsKeyPressed(KEY_DOWN)) input |= INPUT_DOWN;
+    if (IsKeyPressed(KEY_LEFT)) input |= INPUT_LEFT;
+    if (IsKeyPressed(KEY_S)) input |= INPUT_TOGGLE_PATH;
+    if (IsKeyPressed(KEY_E)) input |= INPUT_EXIT_TO_MENU;
+    if (IsKeyDown(KEY_BACKSPACE)) input |= INPUT_REWIND;
+    return input;
+}
+
+// Asset loading: the packed archive, image decoding and scaling, background uploads
+
+// AssetArchive class
+// The packed asset archive, memory-mapped once at startup. find() returns pointers straight
+// into the mapping, so decoders read assets without a copy; they stay valid until close().
+class AssetArchive {
+private:
+    MappedFile file;
+    const AssetPackEntry* entries = nullptr;
+    uint32_t entryCount = 0;
+
+public:
+    // False, leaving the archive closed, if the file is missing or malformed
+    bool open(const char* path) {
+        close();
+        if (!file.open(path)) return false;
+        AssetPackHeader header;
+        if (file.size() < sizeof(header)) {
+            close();
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != ASSET_PACK_MAGIC || header.version != ASSET_PACK_VERSION ||
+            header.entryCount > (file.size() - sizeof(header)) / sizeof(AssetPackEntry)) {
+            close();
+            return false;
+        }
+        entries = (const AssetPackEntry*)(file.data() + sizeof(header));
+        for (uint32_t i = 0; i < header.entryCount; ++i) {
+            if (entries[i].offset > file.size() || entries[i].size > file.size() - entries[i].offset) {
+                close();
+                return false;
+            }
+        }
+        entryCount = header.entryCount;
+        return true;
+    }
+
+    void close() {
+        file.close();
+        entries = nullptr;
+        entryCount = 0;
+    }
+
+    bool isOpen() const { return entries != nullptr; }
+
+    // The packed bytes of 'name', or null if the archive does not have it
+    const unsigned char* find(const char* name, size_t& size) const {
+        for (uint32_t i = 0; i < entryCount; ++i) {
+            if (std::strncmp(entries[i].name, name, ASSET_PACK_NAME_SIZE) == 0) {
+                size = (size_t)entries[i].size;
+                return file.data() + entries[i].offset;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Decodes an image from the archive, or from the loose file when it is not packed
+Image LoadImageAsset(const AssetArchive& archive, const char* path) {
+    size_t size = 0;
+    const unsigned char* packed = archive.find(path, size);
+    if (packed == nullptr) return LoadImage(path);
+    return LoadImageFromMemory(GetFileExtension(path), packed, (int)size);
+}
+
+// Converts an image to RGBA8 at width x height, replacing the one passed in. CPU only, so it
+// can run on any thread.
+Image ScaleImage(Image image, int width, int height) {
+    if (image.data == nullptr) return image;
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    if (image.width != width || image.height != height) {
+        void* scaled = MemAlloc((unsigned int)(width * height * 4));
+        stbir_resize_uint8_srgb((const unsigned char*)image.data, image.width, image.height, 0,
+            (unsigned char*)scaled, width, height, 0, STBIR_RGBA);
+        UnloadImage(image);
+        image = Image{ scaled, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    }
+    return image;
+}
+
+// Uploads a full-screen background from ScaleImage at the window resolution, so drawing
+// it is a plain 1:1 copy. Mipmaps cover the case where the target ends up smaller.
+Texture2D LoadBackgroundTexture(const Image& image) {
+    if (image.data == nullptr) return Texture2D{};
+    Texture2D texture = LoadTextureFromImage(image);
+    GenTextureMipmaps(&texture);
+    SetTextureFilter(texture, TEXTURE_FILTER_TRILINEAR);
+    return texture;
+}
+
+// ImageBatchLoader class
+// Decodes a batch of images in parallel on worker threads. Decoding only touches CPU
+// memory; uploading needs the GL context, so the main thread polls take() and uploads
+// each image as soon as it is ready.
+class ImageBatchLoader {
+private:
+    struct Job {
+        const char* path;
+        int width, height;  // 0 keeps the file's own size
+        Image image{};
+        std::atomic<bool> ready{false};
+        bool taken = false;
+    };
+
+    const AssetArchive& archive;
+    std::vector<std::unique_ptr<Job>> jobs;
+    std::atomic<size_t> nextJob{0};
+    std::vector<std::thread> workers;
+
+    void work() {
+        PROFILE_THREAD_NAME("Asset loader");
+        for (size_t i = nextJob.fetch_add(1); i < jobs.size(); i = nextJob.fetch_add(1)) {
+            Job& job = *jobs[i];
+            {
+                PROFILE_SCOPE("DecodeImage");
+                job.image = LoadImageAsset(archive, job.path);
+                if (job.width > 0) job.image = ScaleImage(job.image, job.width, job.height);
+            }
+            job.ready.store(true, std::memory_order_release);
+        }
+    }
+
+public:
+    explicit ImageBatchLoader(const AssetArchive& assetArchive) : archive(assetArchive) {}
+    ImageBatchLoader(const ImageBatchLoader&) = delete;
+    ImageBatchLoader& operator=(const ImageBatchLoader&) = delete;
+
+    ~ImageBatchLoader() {
+        wait();
+        for (auto& job : jobs) {
+            if (!job->taken) UnloadImage(job->image);
+        }
+    }
+
+    // Queue before start(); returns the index to take() the result with
+    size_t add(const char* path, int width = 0, int height = 0) {
+        jobs.push_back(std::make_unique<Job>());
+        jobs.back()->path = path;
+        jobs.back()->width = width;
+        jobs.back()->height = height;
+        return jobs.size() - 1;
+    }
+
+    void start() {
+        size_t threads = std::min<size_t>(jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back(&ImageBatchLoader::work, this);
+    }
+
+    // Hands over a decoded image once; the caller owns it afterwards
+    bool take(size_t index, Image& image) {
+        Job& job = *jobs[index];
+        if (job.taken || !job.ready.load(std::memory_order_acquire)) return false;
+        job.taken = true;
+        image = job.image;
+        return true;
+    }
+
+    void wait() {
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+    }
+};
+
+// Drawing helpers shared by the live objects and render snapshots
+
+// Fills the current render target with a background from LoadBackgroundTexture
+void DrawBackground(Texture2D background) {
+    int targetWidth = GetRenderWidth();
+    int targetHeight = GetRenderHeight();
+    if (background.width == targetWidth && background.height == targetHeight) {
+        DrawTexture(background, 0, 0, WHITE);
+    } else {
+        DrawTexturePro(background,
+            Rectangle{ 0, 0, (float)background.width, (float)background.height },
+            Rectangle{ 0, 0, (float)targetWidth, (float)targetHeight },
+            Vector2{ 0, 0 }, 0.0f, WHITE);
+    }
+    PROFILE_DRAWS(1);
+}
+
+// Draws a texture centred in maze cell (cellX, cellY), scaled to 'fill' of the cell
+void DrawSpriteInCell(Texture2D texture, float cellX, float cellY, int cellSize, int offsetX, int offsetY, float fill) {
+    float scale = (float)(cellSize * fill) / std::max(texture.width, texture.height);
+    float adjustedX = cellX * cellSize + offsetX + (cellSize - texture.width * scale) / 2;
+    float adjustedY = cellY * cellSize + offsetY + (cellSize - texture.height * scale) / 2;
+    DrawTextureEx(texture, {adjustedX, adjustedY}, 0, scale, WHITE);
+    PROFILE_DRAWS(1);
+}
+
+// Draws every closed side of a maze given its open-direction masks
+void DrawMazeWalls(const uint8_t* masks, int width, int height, int cellSize, int offsetX, int offsetY) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t open = masks[y * width + x];
+            int screenX = x * cellSize + offsetX;
+            int screenY = y * cellSize + offsetY;
+            if (!(open & 1)) DrawLine(screenX, screenY, screenX + cellSize, screenY, WHITE);
+            if (!(open & 2)) DrawLine(screenX + cellSize, screenY, screenX + cellSize, screenY + cellSize, WHITE);
+            if (!(open & 4)) DrawLine(screenX, screenY + cellSize, screenX + cellSize, screenY + cellSize, WHITE);
+            if (!(open & 8)) DrawLine(screenX, screenY, screenX, screenY + cellSize, WHITE);
+            PROFILE_DRAWS(!(open & 1) + !(open & 2) + !(open & 4) + !(open & 8));
+        }
+    }
+}
+
+template <typename Path>
+void DrawPathLine(const Path& path, int cellSize, int offsetX, int offsetY) {
+    if (path.empty()) return;
+
+    for (size_t i = 0; i < path.size() - 1; ++i) {
+        std::pair<int, int> p1 = path[i];
+        std::pair<int, int> p2 = path[i + 1];
+        int x1 = p1.first;
+        int y1 = p1.second;
+        int x2 = p2.first;
+        int y2 = p2.second;
+
+        float startX = x1 * cellSize + cellSize / 2 + offsetX;
+        float startY = y1 * cellSize + cellSize / 2 + offsetY;
+        float endX = x2 * cellSize + cellSize / 2 + offsetX;
+        float endY = y2 * cellSize + cellSize / 2 + offsetY;
+
+        DrawLineEx({startX, startY}, {endX, endY}, 3, YELLOW);
+    }
+    PROFILE_DRAWS(path.size() - 1);
+}
+
+// Cached text. DrawText lays a string out glyph by glyph through the font every call, so
+// strings that rarely change are rasterized once into a texture and drawn as one quad.
+
+// A string baked into its own texture with the default font, in white so any tint works.
+// set() only re-rasterizes when the string or size differs from what is already baked.
+class BakedText {
+private:
+    Texture2D texture{};
+    char text[64] = "";
+    int fontSize = 0;
+
+public:
+    void set(const char* value, int size) {
+        if (texture.id != 0 && size == fontSize && std::strncmp(value, text, sizeof(text) - 1) == 0) return;
+        unload();
+        std::snprintf(text, sizeof(text), "%s", value);
+        fontSize = size;
+        Image image = ImageText(text, fontSize, WHITE);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+
+    void draw(int x, int y, Color tint) const {
+        DrawTexture(texture, x, y, tint);
+        PROFILE_DRAWS(1);
+    }
+
+    void drawCentered(int centerX, int y, Color tint) const {
+        draw(centerX - texture.width / 2, y, tint);
+    }
+
+    int width() const { return texture.width; }
+
+    void unload() {
+        if (texture.id != 0) UnloadTexture(texture);
+        texture = Texture2D{};
+    }
+};
+
+// The glyphs a number needs ("0123456789.-") at one font size, packed into one texture
+class NumberGlyphs {
+private:
+    static constexpr const char* GLYPHS = "0123456789.-";
+    static const int GLYPH_COUNT = 12;
+
+    Texture2D texture{};
+    Rectangle glyphRects[GLYPH_COUNT] = {};
+    int spacing = 0;
+
+public:
+    void load(int fontSize) {
+        Image glyphImages[GLYPH_COUNT];
+        int atlasWidth = 0, atlasHeight = 0;
+        for (int i = 0; i < GLYPH_COUNT; ++i) {
+            char glyph[2] = { GLYPHS[i], '\0' };
+            glyphImages[i] = ImageText(glyph, fontSize, WHITE);
+            atlasWidth += glyphImages[i].width + 1;  // a gap so filtering never bleeds into a neighbour
+            atlasHeight = std::max(atlasHeight, glyphImages[i].height);
+        }
+
+        Image atlas = GenImageColor(std::max(atlasWidth, 1), std::max(atlasHeight, 1), BLANK);
+        int x = 0;
+        for (int i = 0; i < GLYPH_COUNT; ++i) {
+            float w = (float)glyphImages[i].width, h = (float)glyphImages[i].height;
+            ImageDraw(&atlas, glyphImages[i], Rectangle{ 0, 0, w, h }, Rectangle{ (float)x, 0, w, h }, WHITE);
+            glyphRects[i] = Rectangle{ (float)x, 0, w, h };
+            x += glyphImages[i].width + 1;
+            UnloadImage(glyphImages[i]);
+        }
+        texture = LoadTextureFromImage(atlas);
+        UnloadImage(atlas);
+        spacing = fontSize / 10;  // what DrawText uses for the default font
+    }
+
+    void unload() {
+        if (texture.id != 0) UnloadTexture(texture);
+        texture = Texture2D{};
+    }
+
+    // Gap DrawText would leave between the end of a label and the next glyph
+    int glyphSpacing() const { return spacing; }
+
+    // Glyph indices and x offsets for 'text'; characters without a glyph are skipped
+    int layout(const char* text, uint8_t* indices, int* offsets, int capacity) const {
+        int count = 0, x = 0;
+        for (const char* c = text; *c != '\0' && count < capacity; ++c) {
+            const char* glyph = std::strchr(GLYPHS, *c);
+            if (glyph == nullptr) continue;
+            int index = (int)(glyph - GLYPHS);
+            indices[count] = (uint8_t)index;
+            offsets[count] = x;
+            x += (int)glyphRects[index].width + spacing;
+            ++count;
+        }
+        return count;
+    }
+
+    void draw(const uint8_t* indices, const int* offsets, int count, int x, int y, Color tint) const {
+        for (int i = 0; i < count; ++i) {
+            DrawTextureRec(texture, glyphRects[indices[i]], Vector2{ (float)(x + offsets[i]), (float)y }, tint);
+        }
+        PROFILE_DRAWS(count);
+    }
+};
+
+// A number shown with a fixed count of decimals. The string and glyph layout are rebuilt
+// only when the value as displayed changes, not every frame.
+class CachedNumber {
+private:
+    static const int MAX_GLYPHS = 24;
+
+    const NumberGlyphs* glyphs = nullptr;
+    int decimals = 0;
+    double scale = 1.0;
+    long long shownKey = 0;
+    bool valid = false;
+    int glyphCount = 0;
+    uint8_t glyphIndices[MAX_GLYPHS];
+    int glyphOffsets[MAX_GLYPHS];
+
+public:
+    void init(const NumberGlyphs& font, int decimalPlaces) {
+        glyphs = &font;
+        decimals = decimalPlaces;
+        scale = std::pow(10.0, decimals);
+        valid = false;
+    }
+
+    void set(double value) {
+        long long key = std::llround(value * scale);
+        if (valid && key == shownKey) return;
+        shownKey = key;
+        valid = true;
+        char text[MAX_GLYPHS + 1];
+        std::snprintf(text, sizeof(text), "%.*f", decimals, key / scale);
+        glyphCount = glyphs->layout(text, glyphIndices, glyphOffsets, MAX_GLYPHS);
+    }
+
+    void draw(int x, int y, Color tint) const {
+        glyphs->draw(glyphIndices, glyphOffsets, glyphCount, x, y, tint);
+    }
+};
+
+enum class GameState {
+    FIRST_SCREEN,
+    CHARACTER_SELECTION,
+    LEVEL_SELECTION,
+    PLAYING,
+    GAME_OVER,
+    VICTORY
+};
+
+// Maze class
+class Maze {
+private:
+    int width, height;
+    int cellSize;
+    Texture2D startTexture;
+    Texture2D endTexture;
+    int offsetX, offsetY;
+    Texture2D mazeBackground;
+    ArenaVector<uint8_t> openMasks;  // bit d set when direction d is open, row-major
+    ArenaVector<uint8_t> loadScratch;
+
+    // Connected components over a tile map where cells sit on odd coordinates and the
+    // sides between them are tiles of their own, so "can A reach B" is a lookup and a wall
+    // edit is a single-tile update. Null when the maze is too large for the index.
+    stbcc_grid* connectivity;
+    int tileWidth, tileHeight;
+    ArenaVector<uint8_t> tiles;
+
+    void rebuildConnectivity() {
+        if (!connectivity) return;
+        std::memset(connectivity, 0, stbcc_grid_sizeof());
+        std::fill(tiles.begin(), tiles.end(), 1);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                uint8_t open = openMasks[y * width + x];
+                int tile = (2 * y + 1) * tileWidth + 2 * x + 1;
+                tiles[tile] = 0;
+                if (open & 2) tiles[tile + 1] = 0;
+                if (open & 4) tiles[tile + tileWidth] = 0;
+            }
+        }
+        stbcc_init_grid(connectivity, tiles.data(), tileWidth, tileHeight);
+    }
+
+    // Opens side 'direction' of (x, y) and, inside the maze, the facing side of its neighbour
+    void open(int x, int y, int direction) {
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        openMasks[y * width + x] |= 1 << direction;
+        int nx = x + dx[direction];
+        int ny = y + dy[direction];
+        if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
+            openMasks[ny * width + nx] |= 1 << ((direction + 2) % 4);
+        }
+    }
+
+
+public:
+    // All of the maze's storage comes from 'arena', which must outlive it. The open masks
+    // are the only wall store: one byte a cell, which is what lets --export reach 20000².
+    Maze(Arena& arena, int w, int h, int cSize)
+        : width(w), height(h), cellSize(cSize),
+          openMasks((size_t)w * h, 0, ArenaAllocator<uint8_t>(arena)), loadScratch(ArenaAllocator<uint8_t>(arena)),
+          connectivity(nullptr), tiles(ArenaAllocator<uint8_t>(arena)) {
+        // stbcc wants whole clusters on each axis
+        const int cluster = 1 << (STBCC_GRID_COUNT_X_LOG2 / 2);
+        tileWidth = (2 * width + 1 + cluster - 1) / cluster * cluster;
+        tileHeight = (2 * height + 1 + cluster - 1) / cluster * cluster;
+        if (tileWidth <= (1 << STBCC_GRID_COUNT_X_LOG2) && tileHeight <= (1 << STBCC_GRID_COUNT_Y_LOG2)) {
+            connectivity = static_cast<stbcc_grid*>(arena.allocate(stbcc_grid_sizeof(), 64));
+            tiles.resize(tileWidth * tileHeight);
+        }
+        offsetX = (SCREEN_WIDTH - width * cellSize) / 2;
+        offsetY = (SCREEN_HEIGHT - height * cellSize) / 2;
+    }
+
+    void loadTextures(Texture2D start, Texture2D end) {
+        startTexture = start;
+        endTexture = end;
+    }
+
+    // Depth-first carving with no stack: while carving, the spare high bits of each mask
+    // hold a visited flag and the side the cell was entered from, and backtracking follows
+    // those sides home. Draws the same random numbers in the same order as a stack would.
+    void generate() {
+        PROFILE_SCOPE("Maze::generate");
+        const uint8_t VISITED = 0x10;
+        const int BACK_SHIFT = 5;
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        std::fill(openMasks.begin(), openMasks.end(), 0);
+        openMasks[0] = VISITED;
+        int x = 0;
+        int y = 0;
+
+        while (true) {
+            int neighbors[4];
+            int neighborCount = 0;
+
+            if (y > 0 && !(openMasks[(y-1) * width + x] & VISITED)) neighbors[neighborCount++] = 0;
+            if (x < width-1 && !(openMasks[y * width + x+1] & VISITED)) neighbors[neighborCount++] = 1;
+            if (y < height-1 && !(openMasks[(y+1) * width + x] & VISITED)) neighbors[neighborCount++] = 2;
+            if (x > 0 && !(openMasks[y * width + x-1] & VISITED)) neighbors[neighborCount++] = 3;
+
+            if (neighborCount > 0) {
+                int next = neighbors[GameRandom() % neighborCount];
+                int back = (next + 2) % 4;
+                openMasks[y * width + x] |= 1 << next;
+                x += dx[next];
+                y += dy[next];
+                openMasks[y * width + x] = (uint8_t)(VISITED | (1 << back) | (back << BACK_SHIFT));
+            } else if (x == 0 && y == 0) {
+                break;
+            } else {
+                int back = (openMasks[y * width + x] >> BACK_SHIFT) & 3;
+                x += dx[back];
+                y += dy[back];
+            }
+        }
+        for (uint8_t& mask : openMasks) mask &= 0x0F;
+
+        // Randomly remove some walls
+        for (int i = 0; i < width * height / 10; ++i) {
+            int x = GameRandom() % width;
+            int y = GameRandom() % height;
+            int wall = GameRandom() % 4;
+            if (!canMove(x, y, wall)) open(x, y, wall);
+        }
+
+        // After generating the maze and removing some walls, close the border
+        closeBorderWalls();
+        rebuildConnectivity();
+    }
+
+    // Opens or closes one side of a cell and the matching side of its neighbour, keeping the
+    // reachability index in step. The outer border cannot be opened.
+    void setWall(int x, int y, int direction, bool closed) {
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        int nx = x + dx[direction];
+        int ny = y + dy[direction];
+        if (nx < 0 || nx >= width || ny < 0 || ny >= height) return;
+        int opposite = (direction + 2) % 4;
+        if (closed) {
+            openMasks[y * width + x] &= ~(1 << direction);
+            openMasks[ny * width + nx] &= ~(1 << opposite);
+        } else {
+            openMasks[y * width + x] |= 1 << direction;
+            openMasks[ny * width + nx] |= 1 << opposite;
+        }
+        if (connectivity) stbcc_update_grid(connectivity, 2 * x + 1 + dx[direction], 2 * y + 1 + dy[direction], closed);
+    }
+
+    // O(1) lookup in the index; mazes too large for it report true and leave it to the search
+    bool reachable(int fromX, int fromY, int toX, int toY) const {
+        if (!connectivity) return true;
+        return stbcc_query_grid_node_connection(connectivity, 2 * fromX + 1, 2 * fromY + 1, 2 * toX + 1, 2 * toY + 1) != 0;
+    }
+
+    bool hasReachabilityIndex() const { return connectivity != nullptr; }
+
+    // The autopilot and the victory check assume the exit can be reached from the start
+    bool exitReachable() const {
+        return reachable(0, 0, width - 1, height - 1);
+    }
+
+    void closeBorderWalls() {
+        // Close top and bottom walls
+        for (int x = 0; x < width; ++x) {
+            openMasks[x] &= ~1;  // Top wall
+            openMasks[(height-1) * width + x] &= ~4;  // Bottom wall
+        }
+        // Close left and right walls
+        for (int y = 0; y < height; ++y) {
+            openMasks[y * width] &= ~8;  // Left wall
+            openMasks[y * width + width-1] &= ~2;  // Right wall
+        }
+    }
+
+    void draw() const {
+        PROFILE_SCOPE("Maze::draw");
+        DrawMazeWalls(openMasks.data(), width, height, cellSize, offsetX, offsetY);
+
+        // Draw start and end images
+        DrawSpriteInCell(startTexture, 0, 0, cellSize, offsetX, offsetY, 0.8f);
+        DrawSpriteInCell(endTexture, width - 1, height - 1, cellSize, offsetX, offsetY, 0.8f);
+    }
+
+    bool canMove(int x, int y, int direction) const {
+        return (openMasks[y * width + x] >> direction) & 1;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const uint8_t* getOpenMasks() const { return openMasks.data(); }
+
+    // Walls are fully described by the open masks
+    void serialize(StateWriter& out) const {
+        out.putArray(openMasks);
+    }
+
+    // Returns false on malformed input, including walls that seal off the exit, and then
+    // keeps the walls it had; 'changed' tells whether the walls differ from before
+    bool deserialize(StateReader& in, bool* changed = nullptr) {
+        ArenaVector<uint8_t>& masks = loadScratch;
+        if (!in.getArray(masks) || masks.size() != (size_t)width * height) return false;
+        if (changed) *changed = masks != openMasks;
+        if (masks == openMasks) return true;
+        openMasks.swap(masks);
+        rebuildConnectivity();
+        if (!exitReachable()) {
+            openMasks.swap(masks);
+            rebuildConnectivity();
+            return false;
+        }
+        return true;
+    }
+    int getCellSize() const { return cellSize; }
+    int getOffsetX() const { return offsetX; }
+    int getOffsetY() const { return offsetY; }
+
+    // Shortest path by BFS, written to 'path' (empty if there is none). The search keeps one
+    // byte a cell, the side each cell was reached through, and expands a layer at a time, so
+    // only the frontier grows. Its buffers come from 'scratch', so a caller that reuses
+    // 'path' allocates nothing.
+    void findPath(int startX, int startY, int endX, int endY, Arena& scratch, std::vector<std::pair<int, int>>& path) const {
+        PROFILE_SCOPE("Maze::findPath");
+        const uint8_t UNVISITED = 0xFF;
+        const uint8_t ORIGIN = 4;
+        path.clear();
+        if (!reachable(startX, startY, endX, endY)) return;  // no need to flood the whole component
+        ArenaVector<uint8_t> via((size_t)width * height, UNVISITED, ArenaAllocator<uint8_t>(scratch));
+        ArenaVector<int32_t> layer{ArenaAllocator<int32_t>(scratch)};
+        ArenaVector<int32_t> nextLayer{ArenaAllocator<int32_t>(scratch)};
+
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        int start = startY * width + startX;
+        int end = endY * width + endX;
+        via[start] = ORIGIN;
+        layer.push_back(start);
+
+        while (!layer.empty()) {
+            for (int current : layer) {
+                if (current == end) {
+                    for (int cell = end; cell != start; cell -= dy[via[cell]] * width + dx[via[cell]]) {
+                        path.push_back({cell % width, cell / width});
+                    }
+                    path.push_back({startX, startY});
+                    std::reverse(path.begin(), path.end());
+                    return;
+                }
+
+                int x = current % width;
+                int y = current / width;
+                for (int i = 0; i < 4; ++i) {
+                    int nx = x + dx[i];
+                    int ny = y + dy[i];
+                    if (nx >= 0 && nx < width && ny >= 0 && ny < height && via[ny * width + nx] == UNVISITED && canMove(x, y, i)) {
+                        via[ny * width + nx] = (uint8_t)i;
+                        nextLayer.push_back(ny * width + nx);
+                    }
+                }
+            }
+            layer.swap(nextLayer);
+            nextLayer.clear();
+        }
+    }
+
+public:
+    template <typename Path>
+    void drawPath(const Path& path) const {
+        DrawPathLine(path, cellSize, offsetX, offsetY);
+    }
+};
+
+// Player class
+class Player {
+private:
+    int x, y;
+    int prevX, prevY;  // position at the previous tick, for interpolated drawing
+    int power;
+    int score;
+    int weaponsCollected;
+    Texture2D texture;
+    const Maze* maze;
+    ArenaVector<std::pair<int, int>> currentPath; // Added member variable
+
+public:
+    Player(Arena& arena, int startX, int startY, Texture2D playerTexture, const Maze* m, int initialScore = 0) 
+    : x(startX), y(startY), prevX(startX), prevY(startY), power(20), score(initialScore), weaponsCollected(2), texture(playerTexture), maze(m),
+      currentPath(ArenaAllocator<std::pair<int, int>>(arena)) {}
+
+    void move(int dx, int dy) {
+        x += dx;
+        y += dy;
+    }
+
+    void beginTick() {
+        prevX = x;
+        prevY = y;
+    }
+
+    // alpha is how far rendering is between the previous tick and the current one
+    void draw(float alpha) const {
+        float drawX = prevX + (x - prevX) * alpha;
+        float drawY = prevY + (y - prevY) * alpha;
+        DrawSpriteInCell(texture, drawX, drawY, maze->getCellSize(), maze->getOffsetX(), maze->getOffsetY(), 0.8f);
+    }
+
+    void collectWeapon() {
+        power += 10;
+        weaponsCollected++;
+    }
+
+    void hitEnemy() {
+        power -= 10;
+        if (power < 0) power = 0;
+    }
+
+    void addScore(int points) {
+        score += points;
+    }
+
+    int getX() const { return x; }
+    int getY() const { return y; }
+    int getPrevX() const { return prevX; }
+    int getPrevY() const { return prevY; }
+    int getPower() const { return power; }
+    int getScore() const { return score; }
+    int getWeaponsCollected() const { return weaponsCollected; }
+
+    void serialize(StateWriter& out) const {
+        out.put(x);
+        out.put(y);
+        out.put(prevX);
+        out.put(prevY);
+        out.put(power);
+        out.put(score);
+        out.put(weaponsCollected);
+        out.putArray(currentPath);
+    }
+
+    bool deserialize(StateReader& in) {
+        return in.get(x) && in.get(y) && in.get(prevX) && in.get(prevY) && in.get(power) &&
+               in.get(score) && in.get(weaponsCollected) && in.getArray(currentPath);
+    }
+
+    void setPath(const std::vector<std::pair<int, int>>& path) { // Added method
+        currentPath.assign(path.begin(), path.end());
+    }
+
+    const ArenaVector<std::pair<int, int>>& getPath() const { // Added method
+        return currentPath;
+    }
+
+    void clearPath() { // Added method
+        currentPath.clear();
+    }
+
+    // A path visits each cell at most once; room for that many keeps setPath in place
+    void reservePath(size_t cells) {
+        currentPath.reserve(cells);
+    }
+};
+
+// Per-mask lookup tables for the wander step. Slot mask * 4 + k holds the k-th open
+// direction of a cell with that mask; a closed cell has a count of 0 and its slot 0
+// holds a zero step, so every enemy can run the same code whether it moves or not.
+// openSides packs the same directions as 2-bit numbers, first in the low bits, for the
+// SIMD kernels, which look everything up with in-register byte shuffles.
+struct WanderTables {
+    uint8_t openCount[16];
+    uint8_t openSides[16];
+    int8_t stepX[64];
+    int8_t stepY[64];
+
+    WanderTables() {
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        for (int mask = 0; mask < 16; ++mask) {
+            int count = 0;
+            openSides[mask] = 0;
+            for (int d = 0; d < 4; ++d) {
+                stepX[mask * 4 + d] = 0;
+                stepY[mask * 4 + d] = 0;
+            }
+            for (int d = 0; d < 4; ++d) {
+                if (mask & (1 << d)) {
+                    stepX[mask * 4 + count] = (int8_t)dx[d];
+                    stepY[mask * 4 + count] = (int8_t)dy[d];
+                    openSides[mask] |= (uint8_t)(d << (2 * count));
+                    count++;
+                }
+            }
+            openCount[mask] = (uint8_t)count;
+        }
+    }
+};
+
+const WanderTables WANDER_TABLES;
+
+// Key for one wander step of a swarm: every enemy stepped on 'tick' draws from it
+inline uint32_t WanderKey(uint32_t seed, uint64_t tick) {
+    uint32_t key = seed ^ (uint32_t)tick * 0x27d4eb2fu ^ (uint32_t)(tick >> 32);
+    key ^= key >> 16;
+    key *= 0x7feb352du;
+    key ^= key >> 15;
+    return key;
+}
+
+// Counter-based random number for lane 'lane' of a step, read from its high bits. No
+// per-enemy state is read or written: the golden-ratio multiply spreads neighbouring lanes
+// evenly over the range, and WanderKey makes each step's draws unrelated to the last.
+inline uint32_t WanderRandom(uint32_t key, uint32_t lane) {
+    return (key + lane) * 0x9e3779b1u;
+}
+
+void StepWanderersScalar(const uint8_t* masks, int mazeWidth, int16_t* xs, int16_t* ys, uint32_t key, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t r = WanderRandom(key, (uint32_t)i);
+        int32_t mask = masks[ys[i] * mazeWidth + xs[i]];
+        // Multiply-shift maps the high bits of r onto [0, openCount) without a division
+        int32_t choice = (int32_t)(((r >> 16) * WANDER_TABLES.openCount[mask]) >> 16);
+        int32_t slot = mask * 4 + choice;
+        xs[i] = (int16_t)(xs[i] + WANDER_TABLES.stepX[slot]);
+        ys[i] = (int16_t)(ys[i] + WANDER_TABLES.stepY[slot]);
+    }
+}
+
+#ifdef MAZE_X86
+// The SIMD kernels below produce exactly what StepWanderersScalar does, lane for lane,
+// so the choice of kernel never shows up in a state hash. Per 32-bit lane:
+//   cell   madd_epi16 of y and the width, both below 2^15 (MAX_MAZE_SIZE)
+//   mask   32-bit gather at the cell's byte address; a block that could read past the
+//          last cell is handed to the scalar loop instead
+//   choice 16-bit high multiply of r's top half by the open count
+//   side   the choice-th 2-bit field of the mask's openSides, copied into every byte of
+//          the lane plus 0, 4, 4, 4, so one byte shuffle yields the sign-extended step
+// Closed cells (no open side) keep their position through the move mask. r advances by
+// a whole block per iteration instead of being recomputed from key + i.
+
+MAZE_TARGET("avx2")
+void StepWanderersAvx2(const uint8_t* masks, int mazeWidth, int mazeHeight, int16_t* xs, int16_t* ys, uint32_t key, size_t count) {
+    const __m256i lastSafeCell = _mm256_set1_epi32(mazeWidth * mazeHeight - 4);
+    const __m256i width = _mm256_set1_epi32(mazeWidth);
+    const __m256i lowByte = _mm256_set1_epi32(0xff);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i signBytes = _mm256_set1_epi32(0x04040400);
+    const __m256i laneSteps = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)0x9e3779b1u));
+    const __m256i firstByte = _mm256_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12,
+                                               0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+    const __m256i openCount = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)WANDER_TABLES.openCount));
+    const __m256i openSides = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)WANDER_TABLES.openSides));
+    // Bytes 0-3: the step of direction d, bytes 4-7: its sign extension
+    const __m256i stepX = _mm256_setr_epi8(0, 1, 0, -1, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 1, 0, -1, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i stepY = _mm256_setr_epi8(-1, 0, 1, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           -1, 0, 1, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i blockStep = _mm256_set1_epi32((int)(8u * 0x9e3779b1u));
+    __m256i r = _mm256_add_epi32(_mm256_set1_epi32((int)(key * 0x9e3779b1u)), laneSteps);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, r = _mm256_add_epi32(r, blockStep)) {
+        __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(xs + i)));
+        __m256i y = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(ys + i)));
+        __m256i cell = _mm256_add_epi32(_mm256_madd_epi16(y, width), x);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(cell, lastSafeCell)) != 0) {
+            StepWanderersScalar(masks, mazeWidth, xs + i, ys + i, key + (uint32_t)i, 8);
+            continue;
+        }
+        __m256i mask = _mm256_and_si256(_mm256_i32gather_epi32((const int*)masks, cell, 1), lowByte);
+        __m256i open = _mm256_shuffle_epi8(openCount, mask);
+        __m256i choice = _mm256_srli_epi32(_mm256_mulhi_epu16(r, _mm256_slli_epi32(open, 16)), 16);
+        __m256i side = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(openSides, mask), _mm256_add_epi32(choice, choice)), three);
+        side = _mm256_add_epi32(_mm256_shuffle_epi8(side, firstByte), signBytes);
+        __m256i stays = _mm256_cmpeq_epi32(open, _mm256_setzero_si256());
+        x = _mm256_add_epi32(x, _mm256_andnot_si256(stays, _mm256_shuffle_epi8(stepX, side)));
+        y = _mm256_add_epi32(y, _mm256_andnot_si256(stays, _mm256_shuffle_epi8(stepY, side)));
+
+        // Back to 16 bits: packs works per 128-bit half, so its 64-bit quarters come out as x y x y
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(x, y), 0xd8);
+        _mm_storeu_si128((__m128i*)(xs + i), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i*)(ys + i), _mm256_extracti128_si256(packed, 1));
+    }
+    StepWanderersScalar(masks, mazeWidth, xs + i, ys + i, key + (uint32_t)i, count - i);
+}
+
+MAZE_TARGET("avx512f,avx512bw")
+void StepWanderersAvx512(const uint8_t* masks, int mazeWidth, int mazeHeight, int16_t* xs, int16_t* ys, uint32_t key, size_t count) {
+    const __m512i lastSafeCell = _mm512_set1_epi32(mazeWidth * mazeHeight - 4);
+    const __m512i width = _mm512_set1_epi32(mazeWidth);
+    const __m512i lowByte = _mm512_set1_epi32(0xff);
+    const __m512i three = _mm512_set1_epi32(3);
+    const __m512i signBytes = _mm512_set1_epi32(0x04040400);
+    const __m512i laneSteps = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                                 _mm512_set1_epi32((int)0x9e3779b1u));
+    const __m512i firstByte = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12));
+    const __m512i openCount = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)WANDER_TABLES.openCount));
+    const __m512i openSides = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)WANDER_TABLES.openSides));
+    const __m512i stepX = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 0, -1, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m512i stepY = _mm512_broadcast_i32x4(_mm_setr_epi8(-1, 0, 1, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m512i blockStep = _mm512_set1_epi32((int)(16u * 0x9e3779b1u));
+    const __m512i halves = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+    __m512i r = _mm512_add_epi32(_mm512_set1_epi32((int)(key * 0x9e3779b1u)), laneSteps);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, r = _mm512_add_epi32(r, blockStep)) {
+        __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(xs + i)));
+        __m512i y = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(ys + i)));
+        __m512i cell = _mm512_add_epi32(_mm512_madd_epi16(y, width), x);
+        if (_mm512_cmpgt_epi32_mask(cell, lastSafeCell) != 0) {
+            StepWanderersScalar(masks, mazeWidth, xs + i, ys + i, key + (uint32_t)i, 16);
+            continue;
+        }
+        __m512i mask = _mm512_and_si512(_mm512_i32gather_epi32(cell, masks, 1), lowByte);
+        __m512i open = _mm512_shuffle_epi8(openCount, mask);
+        __m512i choice = _mm512_srli_epi32(_mm512_mulhi_epu16(r, _mm512_slli_epi32(open, 16)), 16);
+        __m512i side = _mm512_and_si512(_mm512_srlv_epi32(_mm512_shuffle_epi8(openSides, mask), _mm512_add_epi32(choice, choice)), three);
+        side = _mm512_add_epi32(_mm512_shuffle_epi8(side, firstByte), signBytes);
+        __mmask16 moves = _mm512_test_epi32_mask(open, open);
+        x = _mm512_mask_add_epi32(x, moves, x, _mm512_shuffle_epi8(stepX, side));
+        y = _mm512_mask_add_epi32(y, moves, y, _mm512_shuffle_epi8(stepY, side));
+        __m512i packed = _mm512_permutexvar_epi64(halves, _mm512_packs_epi32(x, y));
+        _mm256_storeu_si256((__m256i*)(xs + i), _mm512_castsi512_si256(packed));
+        _mm256_storeu_si256((__m256i*)(ys + i), _mm512_extracti64x4_epi64(packed, 1));
+    }
+    StepWanderersScalar(masks, mazeWidth, xs + i, ys + i, key + (uint32_t)i, count - i);
+}
+#endif
+
+enum class WanderKernel { SCALAR, AVX2, AVX512 };
+
+const char* WanderKernelName(WanderKernel kernel) {
+    switch (kernel) {
+        case WanderKernel::AVX2: return "avx2";
+        case WanderKernel::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+// Widest kernel this CPU and OS can run
+WanderKernel DetectWanderKernel() {
+#if defined(MAZE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return WanderKernel::SCALAR;
+    __cpuid(info, 1);
+    const int osSavesAvx = (1 << 27) | (1 << 28);  // OSXSAVE and AVX
+    if ((info[2] & osSavesAvx) != osSavesAvx) return WanderKernel::SCALAR;
+    unsigned long long enabled = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx512 = (info[1] & (1 << 16)) && (info[1] & (1 << 30)) && (enabled & 0xe6) == 0xe6;
+    bool avx2 = (info[1] & (1 << 5)) && (enabled & 0x6) == 0x6;
+    if (avx512) return WanderKernel::AVX512;
+    if (avx2) return WanderKernel::AVX2;
+#elif defined(MAZE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return WanderKernel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return WanderKernel::AVX2;
+#endif
+    return WanderKernel::SCALAR;
+}
+
+WanderKernel wanderKernel = DetectWanderKernel();  // also picks MazeRasterizer's; maze_bench switches it to compare
+
+// Moves 'count' enemies one step each through a random open side of their cell. Lane i
+// draws WanderRandom(key, i), so a step over part of an array continues exactly where a
+// step over the whole of it would be: pass key + first index.
+void StepWanderers(const uint8_t* masks, int mazeWidth, int mazeHeight, int16_t* xs, int16_t* ys, uint32_t key, size_t count) {
+#ifdef MAZE_X86
+    if (mazeWidth * mazeHeight >= 4) {
+        if (wanderKernel == WanderKernel::AVX512) return StepWanderersAvx512(masks, mazeWidth, mazeHeight, xs, ys, key, count);
+        if (wanderKernel == WanderKernel::AVX2) return StepWanderersAvx2(masks, mazeWidth, mazeHeight, xs, ys, key, count);
+    }
+#endif
+    (void)mazeHeight;
+    StepWanderersScalar(masks, mazeWidth, xs, ys, key, count);
+}
+
+// Stable reference to a pooled entity. Dense indices change when another entity is
+// swap-removed; a handle does not, and it stops resolving once its entity is gone.
+struct EntityHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const EntityHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// HandlePool class
+// Bookkeeping that ties generational handles to the dense index of an entity. The owner
+// keeps its data packed and removes with swap-and-pop; the pool follows along and reuses
+// freed slots, so heavy spawn and kill churn leaves memory where it was.
+class HandlePool {
+private:
+    std::vector<uint32_t> indexOfSlot;
+    std::vector<uint32_t> generationOfSlot;
+    std::vector<uint32_t> slotOfIndex;
+    std::vector<uint32_t> freeSlots;
+
+public:
+    // Drops every entity and returns to the state of a new pool, so a level hands out the
+    // same handles however it was reached (a recording checks them). Handles given out
+    // before may resolve again; callers reset the timers that hold them at the same time.
+    void clear() {
+        indexOfSlot.clear();
+        generationOfSlot.clear();
+        slotOfIndex.clear();
+        freeSlots.clear();
+    }
+
+    // Registers an entity appended at dense index size()
+    EntityHandle add() {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (uint32_t)indexOfSlot.size();
+            indexOfSlot.push_back(0);
+            generationOfSlot.push_back(0);
+            freeSlots.reserve(indexOfSlot.capacity());  // so removing never allocates
+        }
+        indexOfSlot[slot] = (uint32_t)slotOfIndex.size();
+        slotOfIndex.push_back(slot);
+        return {slot, generationOfSlot[slot]};
+    }
+
+    // Mirrors the owner moving its last entity into 'index' and popping the back
+    void removeAt(int index) {
+        uint32_t slot = slotOfIndex[index];
+        uint32_t lastSlot = slotOfIndex.back();
+        slotOfIndex[index] = lastSlot;
+        indexOfSlot[lastSlot] = index;
+        slotOfIndex.pop_back();
+        generationOfSlot[slot]++;
+        freeSlots.push_back(slot);
+    }
+
+    // Dense index of a live entity, or -1 for a stale or unknown handle
+    int indexOf(EntityHandle handle) const {
+        if (handle.slot >= generationOfSlot.size() || generationOfSlot[handle.slot] != handle.generation) return -1;
+        return (int)indexOfSlot[handle.slot];
+    }
+
+    EntityHandle handleAt(int index) const {
+        uint32_t slot = slotOfIndex[index];
+        return {slot, generationOfSlot[slot]};
+    }
+
+    size_t size() const { return slotOfIndex.size(); }
+
+    void serialize(StateWriter& out) const {
+        out.putArray(indexOfSlot);
+        out.putArray(generationOfSlot);
+        out.putArray(slotOfIndex);
+        out.putArray(freeSlots);
+    }
+
+    bool deserialize(StateReader& in, size_t expectedSize) {
+        if (!(in.getArray(indexOfSlot) && in.getArray(generationOfSlot) && in.getArray(slotOfIndex) && in.getArray(freeSlots))) {
+            return false;
+        }
+        if (slotOfIndex.size() != expectedSize || generationOfSlot.size() != indexOfSlot.size()) return false;
+        for (uint32_t slot : slotOfIndex) {
+            if (slot >= indexOfSlot.size()) return false;
+        }
+        for (uint32_t slot : freeSlots) {
+            if (slot >= indexOfSlot.size()) return false;
+        }
+        return true;
+    }
+};
+
+// What a scheduled timer does when it comes due
+enum TimerKind : uint32_t {
+    TIMER_ENEMY_MOVE = 0
+};
+
+struct TimerEvent {
+    uint64_t due;
+    uint32_t kind;
+    EntityHandle target;
+};
+
+// TimerWheel class
+// Hierarchical timing wheel over simulation ticks: four levels of 64 slots, so a timer is
+// filed by how far away it is and is moved down a level only when its slot's turn comes.
+// Advancing a tick touches just the timers that are due, plus an occasional cascade, so
+// entities waiting on a timer cost nothing in between. Nodes are pooled and reused.
+// Timers are not cancelled; a handle that no longer resolves is skipped when it fires.
+class TimerWheel {
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    struct Node {
+        TimerEvent event;
+        int32_t next;
+    };
+
+    std::vector<Node> nodes;
+    int32_t freeNode = -1;
+    int32_t heads[LEVELS][SLOTS];
+    uint64_t now = 0;  // last tick advanced to
+    size_t pending = 0;
+    mutable std::vector<TimerEvent> sortScratch;
+
+    // Lowest level whose slot range holds 'due', judged by the tick bits above that level
+    void place(int32_t node) {
+        uint64_t due = nodes[node].event.due;
+        int level = 0;
+        while (level < LEVELS - 1 && (due >> (SLOT_BITS * (level + 1))) != (now >> (SLOT_BITS * (level + 1)))) level++;
+        int slot = (int)((due >> (SLOT_BITS * level)) & (SLOTS - 1));
+        nodes[node].next = heads[level][slot];
+        heads[level][slot] = node;
+    }
+
+    void release(int32_t node) {
+        nodes[node].next = freeNode;
+        freeNode = node;
+    }
+
+public:
+    TimerWheel() { reset(); }
+
+    void reset(uint64_t tick = 0) {
+        std::fill(&heads[0][0], &heads[0][0] + LEVELS * SLOTS, -1);
+        nodes.clear();
+        freeNode = -1;
+        now = tick;
+        pending = 0;
+    }
+
+    // Fires 'delay' ticks after the current one (at least one)
+    void schedule(uint64_t delay, uint32_t kind, EntityHandle target) {
+        int32_t node;
+        if (freeNode != -1) {
+            node = freeNode;
+            freeNode = nodes[node].next;
+        } else {
+            node = (int32_t)nodes.size();
+            nodes.push_back(Node());
+        }
+        nodes[node].event = {now + std::max<uint64_t>(delay, 1), kind, target};
+        place(node);
+        pending++;
+    }
+
+    // Moves to the next tick and appends the timers due on it to 'fired', in a fixed order
+    void advance(std::vector<TimerEvent>& fired) {
+        now++;
+        // Crossing a boundary of level l refiles that level's current slot one level down;
+        // higher levels go first, since they may refile into the slot below them
+        int crossed = 0;
+        while (crossed + 1 < LEVELS && (now & ((1ull << (SLOT_BITS * (crossed + 1))) - 1)) == 0) crossed++;
+        for (int level = crossed; level >= 1; --level) {
+            int slot = (int)((now >> (SLOT_BITS * level)) & (SLOTS - 1));
+            int32_t node = heads[level][slot];
+            heads[level][slot] = -1;
+            while (node != -1) {
+                int32_t next = nodes[node].next;
+                place(node);
+                node = next;
+            }
+        }
+
+        size_t firstFired = fired.size();
+        int slot = (int)(now & (SLOTS - 1));
+        int32_t node = heads[0][slot];
+        heads[0][slot] = -1;
+        while (node != -1) {
+            int32_t next = nodes[node].next;
+            fired.push_back(nodes[node].event);
+            release(node);
+            pending--;
+            node = next;
+        }
+        // List order depends on insertion history, which a reload does not reproduce
+        std::sort(fired.begin() + firstFired, fired.end(), [](const TimerEvent& a, const TimerEvent& b) {
+            return a.kind != b.kind ? a.kind < b.kind : a.target.slot < b.target.slot;
+        });
+    }
+
+    uint64_t currentTick() const { return now; }
+    size_t size() const { return pending; }
+
+    // Pending timers in a canonical order, so equal schedules serialize to equal bytes
+    void serialize(StateWriter& out) const {
+        std::vector<TimerEvent>& events = sortScratch;
+        events.clear();
+        for (int level = 0; level < LEVELS; ++level) {
+            for (int slot = 0; slot < SLOTS; ++slot) {
+                for (int32_t node = heads[level][slot]; node != -1; node = nodes[node].next) events.push_back(nodes[node].event);
+            }
+        }
+        std::sort(events.begin(), events.end(), [](const TimerEvent& a, const TimerEvent& b) {
+            if (a.due != b.due) return a.due < b.due;
+            if (a.kind != b.kind) return a.kind < b.kind;
+            return a.target.slot != b.target.slot ? a.target.slot < b.target.slot : a.target.generation < b.target.generation;
+        });
+        out.put(now);
+        out.put((uint32_t)events.size());
+        for (const TimerEvent& event : events) {
+            out.put(event.due);
+            out.put(event.kind);
+            out.put(event.target);
+        }
+    }
+
+    bool deserialize(StateReader& in) {
+        uint64_t tick = 0;
+        uint32_t count = 0;
+        if (!in.get(tick) || !in.get(count)) return false;
+        reset(tick);
+        for (uint32_t i = 0; i < count; ++i) {
+            TimerEvent event;
+            if (!in.get(event.due) || !in.get(event.kind) || !in.get(event.target) || event.due <= tick) return false;
+            schedule(event.due - tick, event.kind, event.target);
+        }
+        return true;
+    }
+};
+
+// EnemySwarm class
+// All enemies of a level as parallel arrays; ids are indices and removal is swap-and-pop.
+// Positions are 16-bit, which halves what a wander step streams through; mazes stay
+// below MAX_MAZE_SIZE cells across.
+class EnemySwarm {
+private:
+    std::vector<int16_t> xs, ys;
+    std::vector<int16_t> prevXs, prevYs;  // positions at the previous tick, for interpolated drawing
+    std::vector<int> health;
+    uint32_t wanderSeed = 0;  // with the tick, keys the random choices of a step
+    HandlePool handles;
+    std::vector<EntityHandle> steppedLastTick;  // their previous-tick positions are stale
+
+public:
+    void clear() {
+        handles.clear();
+        steppedLastTick.clear();
+        xs.clear();
+        ys.clear();
+        prevXs.clear();
+        prevYs.clear();
+        health.clear();
+    }
+
+    void setWanderSeed(uint32_t seed) { wanderSeed = seed; }
+
+    // Sizes the stepped list for every current enemy stepping on one tick
+    void reserveSteps() { steppedLastTick.reserve(xs.size()); }
+
+    int add(int x, int y) {
+        xs.push_back((int16_t)x);
+        ys.push_back((int16_t)y);
+        prevXs.push_back((int16_t)x);
+        prevYs.push_back((int16_t)y);
+        health.push_back(10);
+        handles.add();
+        return (int)xs.size() - 1;
+    }
+
+    void removeAt(int id) {
+        handles.removeAt(id);
+        int last = (int)xs.size() - 1;
+        xs[id] = xs[last];
+        ys[id] = ys[last];
+        prevXs[id] = prevXs[last];
+        prevYs[id] = prevYs[last];
+        health[id] = health[last];
+        xs.pop_back();
+        ys.pop_back();
+        prevXs.pop_back();
+        prevYs.pop_back();
+        health.pop_back();
+    }
+
+    // Starts a simulation tick: enemies that stepped on the last one now rest where they are
+    void beginTick() {
+        for (EntityHandle handle : steppedLastTick) {
+            int id = handles.indexOf(handle);
+            if (id < 0) continue;
+            prevXs[id] = xs[id];
+            prevYs[id] = ys[id];
+        }
+        steppedLastTick.clear();
+    }
+
+    // Moves the enemies at 'ids' a step, each drawing lane 'id' as in a whole-swarm pass.
+    // An enemy has one move timer, so no id repeats. When every enemy is due this is one
+    // kernel call over the arrays; otherwise 'ids' is sorted and each run of consecutive
+    // ids is one call.
+    void step(std::vector<int>& ids, const Maze& maze, uint64_t tick) {
+        for (int id : ids) steppedLastTick.push_back(handles.handleAt(id));
+        uint32_t key = WanderKey(wanderSeed, tick);
+        if (ids.size() == xs.size()) {
+            StepWanderers(maze.getOpenMasks(), maze.getWidth(), maze.getHeight(), xs.data(), ys.data(), key, xs.size());
+            return;
+        }
+        std::sort(ids.begin(), ids.end());
+        for (size_t first = 0; first < ids.size();) {
+            size_t last = first + 1;
+            while (last < ids.size() && ids[last] == ids[last - 1] + 1) last++;
+            int id = ids[first];
+            StepWanderers(maze.getOpenMasks(), maze.getWidth(), maze.getHeight(), &xs[id], &ys[id],
+                          key + (uint32_t)id, last - first);
+            first = last;
+        }
+    }
+
+    void draw(const Maze& maze, Texture2D texture, float alpha) const {
+        for (size_t i = 0; i < xs.size(); ++i) {
+            float drawX = prevXs[i] + (xs[i] - prevXs[i]) * alpha;
+            float drawY = prevYs[i] + (ys[i] - prevYs[i]) * alpha;
+            DrawSpriteInCell(texture, drawX, drawY, maze.getCellSize(), maze.getOffsetX(), maze.getOffsetY(), 0.8f);
+        }
+    }
+
+    void serialize(StateWriter& out) const {
+        out.putArray(xs);
+        out.putArray(ys);
+        out.putArray(prevXs);
+        out.putArray(prevYs);
+        out.putArray(health);
+        out.put(wanderSeed);
+        handles.serialize(out);
+        out.putArray(steppedLastTick);
+    }
+
+    bool deserialize(StateReader& in) {
+        if (!(in.getArray(xs) && in.getArray(ys) && in.getArray(prevXs) && in.getArray(prevYs) &&
+              in.getArray(health) && in.get(wanderSeed) && handles.deserialize(in, xs.size()) &&
+              in.getArray(steppedLastTick))) {
+            return false;
+        }
+        size_t n = xs.size();
+        return ys.size() == n && prevXs.size() == n && prevYs.size() == n && health.size() == n;
+    }
+
+    size_t size() const { return xs.size(); }
+    bool isAlive(int id) const { return health[id] > 0; }
+    int getX(int id) const { return xs[id]; }
+    int getY(int id) const { return ys[id]; }
+    const std::vector<int16_t>& getXs() const { return xs; }
+    const std::vector<int16_t>& getYs() const { return ys; }
+    const std::vector<int16_t>& getPrevXs() const { return prevXs; }
+    const std::vector<int16_t>& getPrevYs() const { return prevYs; }
+    // Teleports snap instead of being interpolated across the maze
+    void setPosition(int id, int x, int y) {
+        xs[id] = prevXs[id] = (int16_t)x;
+        ys[id] = prevYs[id] = (int16_t)y;
+    }
+    int getHealth(int id) const { return health[id]; }
+    void damage(int id, int amount) { health[id] -= amount; }
+    EntityHandle handleAt(int id) const { return handles.handleAt(id); }
+    int indexOf(EntityHandle handle) const { return handles.indexOf(handle); }
+};
+
+// Weapon class
+class Weapon {
+private:
+    int x, y;
+    const Maze* maze;
+    Texture2D texture;
+
+public:
+    Weapon(int startX, int startY, const Maze* m, Texture2D weaponTexture) 
+        : x(startX), y(startY), maze(m), texture(weaponTexture) {}
+
+    void draw() const {
+        DrawSpriteInCell(texture, x, y, maze->getCellSize(), maze->getOffsetX(), maze->getOffsetY(), 0.6f);
+    }
+
+    int getX() const { return x; }
+    int getY() const { return y; }
+};
+
+// WeaponPool class
+// Packed weapons with swap-and-pop removal and generational handles, like EnemySwarm
+class WeaponPool {
+private:
+    std::vector<Weapon> items;
+    HandlePool handles;
+
+public:
+    void clear() {
+        items.clear();
+        handles.clear();
+    }
+
+    int add(int x, int y, const Maze* maze, Texture2D texture) {
+        items.emplace_back(x, y, maze, texture);
+        handles.add();
+        return (int)items.size() - 1;
+    }
+
+    void removeAt(int id) {
+        handles.removeAt(id);
+        items[id] = items.back();
+        items.pop_back();
+    }
+
+    size_t size() const { return items.size(); }
+    const Weapon& operator[](size_t id) const { return items[id]; }
+    std::vector<Weapon>::const_iterator begin() const { return items.begin(); }
+    std::vector<Weapon>::const_iterator end() const { return items.end(); }
+    EntityHandle handleAt(int id) const { return handles.handleAt(id); }
+    int indexOf(EntityHandle handle) const { return handles.indexOf(handle); }
+
+    void serializeHandles(StateWriter& out) const { handles.serialize(out); }
+    bool deserializeHandles(StateReader& in) { return handles.deserialize(in, items.size()); }
+};
+
+// SpawnPlacer class
+// Picks distinct spawn cells without retry loops. prepare() runs one BFS from an origin and
+// lists the reachable cells far enough from it; each take() is one step of a Fisher-Yates
+// shuffle over that list, so placing k entities costs O(k) however crowded the level is.
+// With a spacing, cells too close to an earlier pick are dropped as the shuffle reaches
+// them (Poisson-disk dart throwing), which spreads entities out and still never loops.
+class SpawnPlacer {
+private:
+    static const uint8_t REACHED = 1;
+    static const uint8_t BLOCKED = 2;
+
+    int width = 0, height = 0;
+    std::vector<uint8_t> flags;       // REACHED and BLOCKED per cell
+    std::vector<int32_t> layer;       // BFS frontier
+    std::vector<int32_t> nextLayer;
+    std::vector<int32_t> candidates;  // the first 'remaining' are still available
+    size_t remaining = 0;
+
+    void block(int x, int y, int spacing) {
+        int radius = std::max(spacing - 1, 0);
+        for (int by = std::max(y - radius, 0); by <= std::min(y + radius, height - 1); ++by) {
+            for (int bx = std::max(x - radius, 0); bx <= std::min(x + radius, width - 1); ++bx) {
+                flags[by * width + bx] |= BLOCKED;
+            }
+        }
+    }
+
+public:
+    // Lists cells reachable from the origin, at least minDistance steps away, for which
+    // accept(x, y) holds. The search goes a layer at a time, so apart from the candidate
+    // list it needs one byte a cell and the frontier.
+    template <typename Accept>
+    void prepare(const Maze& maze, int originX, int originY, int minDistance, Accept accept) {
+        width = maze.getWidth();
+        height = maze.getHeight();
+        flags.assign((size_t)width * height, 0);
+        layer.clear();
+        nextLayer.clear();
+        candidates.clear();
+        candidates.reserve((size_t)width * height);  // only the pages written are ever touched
+
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        flags[originY * width + originX] = REACHED;
+        layer.push_back(originY * width + originX);
+        for (int distance = 0; !layer.empty(); ++distance) {
+            for (int cell : layer) {
+                int x = cell % width;
+                int y = cell / width;
+                if (distance >= minDistance && accept(x, y)) candidates.push_back(cell);
+                for (int d = 0; d < 4; ++d) {
+                    int next = (y + dy[d]) * width + x + dx[d];
+                    if (maze.canMove(x, y, d) && !(flags[next] & REACHED)) {
+                        flags[next] = REACHED;
+                        nextLayer.push_back(next);
+                    }
+                }
+            }
+            layer.swap(nextLayer);
+            nextLayer.clear();
+        }
+        remaining = candidates.size();
+    }
+
+    // Next cell in shuffled order at least 'spacing' cells (Chebyshev) from earlier picks;
+    // false once the list runs out
+    bool take(int& x, int& y, int spacing = 0) {
+        while (remaining > 0) {
+            size_t pick = GameRandom() % remaining;
+            int cell = candidates[pick];
+            candidates[pick] = candidates[--remaining];
+            if (flags[cell] & BLOCKED) continue;
+            x = cell % width;
+            y = cell / width;
+            block(x, y, spacing);
+            return true;
+        }
+        return false;
+    }
+
+    // Gives back the per-cell buffers, which for a huge maze are most of the memory in use
+    void release() {
+        *this = SpawnPlacer();
+    }
+};
+
+// OccupancyGrid class
+// Per-cell intrusive lists of entity ids (indices into the owning vector), so
+// cell, radius and nearest lookups only touch the cells around the query.
+class OccupancyGrid {
+private:
+    // Mazes up to DENSE_CELLS keep one list head per cell, allocated at reset(), so play never
+    // allocates. Larger ones (--export at 20000²) keep heads in pages of PAGE_CELLS cells,
+    // handed out the first time something is filed in them, and pay only for the few used.
+    static const int PAGE_BITS = 8;
+    static const int PAGE_CELLS = 1 << PAGE_BITS;
+    static const int DENSE_CELLS = 1 << 24;
+
+    int width, height;
+    bool paged;
+    std::vector<int> pageStart;  // offset of each page in 'heads', -1 until it is needed
+    std::vector<int> heads;      // first id filed in each cell, -1 when empty
+    std::vector<int> nextId;
+    std::vector<int> prevId;
+    std::vector<int> cellOf;
+
+    int headOf(int cell) const {
+        if (!paged) return heads[cell];
+        int page = pageStart[cell >> PAGE_BITS];
+        return page < 0 ? -1 : heads[page + (cell & (PAGE_CELLS - 1))];
+    }
+
+    int& headSlot(int cell) {
+        if (!paged) return heads[cell];
+        int& page = pageStart[cell >> PAGE_BITS];
+        if (page < 0) {
+            page = (int)heads.size();
+            heads.resize(heads.size() + PAGE_CELLS, -1);
+        }
+        return heads[page + (cell & (PAGE_CELLS - 1))];
+    }
+
+    void link(int id, int cell) {
+        int& head = headSlot(cell);
+        cellOf[id] = cell;
+        prevId[id] = -1;
+        nextId[id] = head;
+        if (head != -1) prevId[head] = id;
+        head = id;
+    }
+
+    void unlink(int id) {
+        int cell = cellOf[id];
+        if (prevId[id] != -1) nextId[prevId[id]] = nextId[id];
+        else headSlot(cell) = nextId[id];
+        if (nextId[id] != -1) prevId[nextId[id]] = prevId[id];
+    }
+
+public:
+    OccupancyGrid() : width(0), height(0), paged(false) {}
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        paged = w * h > DENSE_CELLS;
+        if (paged) {
+            heads.clear();
+            pageStart.assign((w * h + PAGE_CELLS - 1) >> PAGE_BITS, -1);
+        } else {
+            heads.assign(w * h, -1);
+            pageStart.clear();
+        }
+    }
+
+    void insert(int id, int x, int y) {
+        if (id >= (int)cellOf.size()) {
+            nextId.resize(id + 1);
+            prevId.resize(id + 1);
+            cellOf.resize(id + 1);
+        }
+        link(id, y * width + x);
+    }
+
+    void remove(int id) {
+        unlink(id);
+    }
+
+    void move(int id, int x, int y) {
+        int cell = y * width + x;
+        if (cellOf[id] == cell) return;
+        unlink(id);
+        link(id, cell);
+    }
+
+    // The entity filed as 'from' is now known as 'to' (used after swap-and-pop removal)
+    void rename(int from, int to) {
+        int cell = cellOf[from];
+        int p = prevId[from];
+        int n = nextId[from];
+        cellOf[to] = cell;
+        prevId[to] = p;
+        nextId[to] = n;
+        if (p != -1) nextId[p] = to;
+        else headSlot(cell) = to;
+        if (n != -1) prevId[n] = to;
+    }
+
+    int first(int x, int y) const { return headOf(y * width + x); }
+    int next(int id) const { return nextId[id]; }
+    bool empty(int x, int y) const { return headOf(y * width + x) == -1; }
+
+    // Visits every id within 'radius' cells (Chebyshev distance) of (cx, cy)
+    template <typename Fn>
+    void forEachInRadius(int cx, int cy, int radius, Fn fn) const {
+        int minX = std::max(0, cx - radius), maxX = std::min(width - 1, cx + radius);
+        int minY = std::max(0, cy - radius), maxY = std::min(height - 1, cy + radius);
+        for (int y = minY; y <= maxY; ++y) {
+            for (int x = minX; x <= maxX; ++x) {
+                for (int id = headOf(y * width + x); id != -1; id = nextId[id]) {
+                    fn(id, x, y);
+                }
+            }
+        }
+    }
+
+    // Closest id to (cx, cy) by Manhattan distance, searching outward ring by ring; -1 if none
+    // within 'maxRadius' rings (Chebyshev distance, as forEachInRadius)
+    int nearest(int cx, int cy, int maxRadius) const {
+        int best = -1;
+        int bestDist = 0;
+        for (int r = 0; r <= maxRadius; ++r) {
+            // Anything on this ring or a later one is at least r away
+            if (best != -1 && bestDist <= r) break;
+            for (int y = cy - r; y <= cy + r; ++y) {
+                if (y < 0 || y >= height) continue;
+                bool edgeRow = (y == cy - r || y == cy + r);
+                int step = edgeRow ? 1 : std::max(2 * r, 1);
+                for (int x = cx - r; x <= cx + r; x += step) {
+                    if (x < 0 || x >= width) continue;
+                    int id = headOf(y * width + x);
+                    if (id == -1) continue;
+                    int dist = abs(x - cx) + abs(y - cy);
+                    if (best == -1 || dist < bestDist) {
+                        best = id;
+                        bestDist = dist;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+};
+
+// Level class
+class Level {
+private:
+    int difficulty;
+    int mazeSize;
+
+public:
+    Level(int diff) : difficulty(diff) {
+        switch (difficulty) {
+            case 1: mazeSize = 10; break;
+            case 2: mazeSize = 15; break;
+            case 3: mazeSize = 20; break;
+            default: mazeSize = 10; break;
+        }
+    }
+
+    int getMazeSize() const { return mazeSize; }
+};
+
+// ExportRect struct
+// Axis-aligned pixel rectangle [x0, x1) x [y0, y1) drawn over the maze by MazeRasterizer
+struct ExportRect {
+    int x0, y0, x1, y1;
+    uint32_t color;
+};
+
+// Packs a raylib Color into the RGBA byte order the image writers expect
+uint32_t PackRGBA(Color c) {
+    return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+}
+
+#ifdef MAZE_X86
+// Emits one maze image row eight pixels per store. Pixel p lies in cell p / cellPx at
+// offset p % cellPx; laneCell and laneInSide hold, for every offset the first lane can
+// start at, each lane's cell relative to the first one and whether it is past the wall
+// post. The masks of the next eight cells are widened to one per lane and permuted into
+// place, the lane's open bit is tested, and the colour is blended from the result.
+// Stops eight cells short of the row's end, so loads never read past it, and returns how
+// many pixels it wrote; the caller finishes the row.
+MAZE_TARGET("avx2")
+int RasterizeMaskRowAvx2(const uint8_t* maskRow, int width, int cellPx, const int32_t* laneCell, const int32_t* laneInSide,
+                         bool wallRow, uint32_t wallColor, uint32_t floorColor, uint32_t* out) {
+    const __m256i wallPixel = _mm256_set1_epi32((int)wallColor);
+    const __m256i floorPixel = _mm256_set1_epi32((int)floorColor);
+    // Wall rows open the side past the post through bit 0 (up); floor rows open the post
+    // through bit 3 (left) and always have floor past it
+    const __m256i sideBit = _mm256_set1_epi32(wallRow ? 1 : 0);
+    const __m256i postBit = _mm256_set1_epi32(wallRow ? 0 : 8);
+    const __m256i sideAlwaysOpen = _mm256_set1_epi32(wallRow ? 0 : -1);
+    const int cellsPerBlock = 8 / cellPx;
+    const int offsetPerBlock = 8 % cellPx;
+    int cell = 0, offset = 0, p = 0;
+    for (; cell + 8 <= width; p += 8) {
+        __m256i cellMasks = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(maskRow + cell)));
+        __m256i mask = _mm256_permutevar8x32_epi32(cellMasks, _mm256_loadu_si256((const __m256i*)(laneCell + offset * 8)));
+        __m256i inSide = _mm256_loadu_si256((const __m256i*)(laneInSide + offset * 8));
+        __m256i bit = _mm256_blendv_epi8(postBit, sideBit, inSide);
+        __m256i closed = _mm256_cmpeq_epi32(_mm256_and_si256(mask, bit), _mm256_setzero_si256());
+        closed = _mm256_andnot_si256(_mm256_and_si256(sideAlwaysOpen, inSide), closed);
+        _mm256_storeu_si256((__m256i*)(out + p), _mm256_blendv_epi8(floorPixel, wallPixel, closed));
+        cell += cellsPerBlock;
+        offset += offsetPerBlock;
+        if (offset >= cellPx) {
+            offset -= cellPx;
+            cell++;
+        }
+    }
+    return p;
+}
+#endif
+
+// MazeRasterizer class
+// Renders a maze on the CPU straight from its open-direction masks, one horizontal strip
+// at a time, so images far larger than memory can be produced. Every cell is cellPx square
+// with its top and left walls wallPx thick; the bottom and right border close the image.
+class MazeRasterizer {
+private:
+    const uint8_t* masks;
+    int width, height;
+    int cellPx, wallPx;
+    uint32_t wallColor, floorColor;
+    std::vector<ExportRect> rects;  // overlays sorted by y0
+    int maxRectHeight;
+    size_t firstRect;
+    // Per starting offset within a cell, eight lanes of: cell relative to the first, and
+    // -1 past the wall post (see RasterizeMaskRowAvx2)
+    std::vector<int32_t> laneCell;
+    std::vector<int32_t> laneInSide;
+
+    // One row of cells: wall rows hold the corner posts and top sides, floor rows the left
+    // sides and open floor
+    void rasterizeRow(const uint8_t* maskRow, bool wallRow, uint32_t* row) {
+        int p = 0;
+#ifdef MAZE_X86
+        if (wanderKernel >= WanderKernel::AVX2) {
+            p = RasterizeMaskRowAvx2(maskRow, width, cellPx, laneCell.data(), laneInSide.data(), wallRow, wallColor,
+                                     floorColor, row);
+        }
+#endif
+        int x = p / cellPx;
+        int within = p % cellPx;
+        uint32_t* px = row + p;
+        for (; x < width; ++x, within = 0) {
+            uint32_t post = wallRow ? wallColor : (maskRow[x] & 8) ? floorColor : wallColor;
+            uint32_t side = !wallRow ? floorColor : (maskRow[x] & 1) ? floorColor : wallColor;
+            if (within < wallPx) px = std::fill_n(px, wallPx - within, post);
+            px = std::fill_n(px, cellPx - std::max(within, wallPx), side);
+        }
+        std::fill_n(px, wallPx, wallColor);
+    }
+
+public:
+    MazeRasterizer(const uint8_t* openMasks, int w, int h, int cellPixels, int wallPixels)
+        : masks(openMasks), width(w), height(h), cellPx(cellPixels), wallPx(wallPixels),
+          wallColor(PackRGBA(WHITE)), floorColor(PackRGBA(BLACK)), maxRectHeight(0), firstRect(0) {
+        laneCell.resize((size_t)cellPx * 8);
+        laneInSide.resize((size_t)cellPx * 8);
+        for (int offset = 0; offset < cellPx; ++offset) {
+            for (int lane = 0; lane < 8; ++lane) {
+                laneCell[offset * 8 + lane] = (offset + lane) / cellPx;
+                laneInSide[offset * 8 + lane] = (offset + lane) % cellPx < wallPx ? 0 : -1;
+            }
+        }
+    }
+
+    int imageWidth() const { return width * cellPx + wallPx; }
+    int imageHeight() const { return height * cellPx + wallPx; }
+
+    // Marks the open floor of a cell, shrunk by 'inset' pixels on every side
+    void addCellMarker(int cx, int cy, int inset, Color color) {
+        int x0 = cx * cellPx + wallPx + inset;
+        int y0 = cy * cellPx + wallPx + inset;
+        int size = std::max(1, cellPx - wallPx - 2 * inset);
+        addRect({x0, y0, x0 + size, y0 + size, PackRGBA(color)});
+    }
+
+    // Centre-to-centre segments between consecutive cells of a path
+    void addPath(const std::vector<std::pair<int, int>>& path, Color color) {
+        int floor = cellPx - wallPx;
+        int thickness = std::max(1, floor / 3);
+        int centre = wallPx + (floor - thickness) / 2;
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            int ax = path[i].first * cellPx + centre, ay = path[i].second * cellPx + centre;
+            int bx = path[i + 1].first * cellPx + centre, by = path[i + 1].second * cellPx + centre;
+            addRect({std::min(ax, bx), std::min(ay, by), std::max(ax, bx) + thickness, std::max(ay, by) + thickness,
+                     PackRGBA(color)});
+        }
+    }
+
+    void addRect(const ExportRect& rect) {
+        rects.push_back(rect);
+        maxRectHeight = std::max(maxRectHeight, rect.y1 - rect.y0);
+    }
+
+    // Call once after all overlays are added and before the first strip
+    void finishOverlays() {
+        std::sort(rects.begin(), rects.end(), [](const ExportRect& a, const ExportRect& b) { return a.y0 < b.y0; });
+        firstRect = 0;
+    }
+
+    // Fills 'rows' image rows starting at y0 into out (rows * imageWidth() pixels). Strips
+    // must be requested top to bottom.
+    void renderStrip(int y0, int rows, uint32_t* out) {
+        int imageW = imageWidth();
+        int mazeBottom = height * cellPx;
+        for (int r = 0; r < rows; ++r) {
+            int py = y0 + r;
+            uint32_t* row = out + (size_t)r * imageW;
+            if (py >= mazeBottom) {
+                std::fill_n(row, imageW, wallColor);
+                continue;
+            }
+
+            int within = py % cellPx;
+            // Floor rows of a cell row are identical, so only the first one is rasterized
+            if (r > 0 && within > wallPx) {
+                std::copy_n(row - imageW, imageW, row);
+                continue;
+            }
+
+            rasterizeRow(masks + (size_t)(py / cellPx) * width, within < wallPx, row);
+        }
+
+        // Overlays that can reach this strip
+        int y1 = y0 + rows;
+        while (firstRect < rects.size() && rects[firstRect].y0 + maxRectHeight <= y0) firstRect++;
+        for (size_t i = firstRect; i < rects.size() && rects[i].y0 < y1; ++i) {
+            const ExportRect& rect = rects[i];
+            int top = std::max(rect.y0, y0), bottom = std::min(rect.y1, y1);
+            int left = std::max(rect.x0, 0), right = std::min(rect.x1, imageW);
+            for (int y = top; y < bottom; ++y) {
+                std::fill_n(out + (size_t)(y - y0) * imageW + left, std::max(0, right - left), rect.color);
+            }
+        }
+    }
+};
+
+// ImageStreamWriter class
+// Receives an RGBA image top to bottom, a strip of rows at a time
+class ImageStreamWriter {
+public:
+    virtual ~ImageStreamWriter() {}
+    virtual bool begin(const std::string& path, int width, int height) = 0;
+    virtual bool writeRows(const uint32_t* pixels, int rows) = 0;
+    virtual bool end() = 0;
+};
+
+// QoiStreamWriter class
+// Encodes the QOI format incrementally. qoi.h only encodes a whole image held in memory;
+// the format itself is a single pass with a small running state, so strips can be
+// encoded as they arrive and any image size is supported.
+class QoiStreamWriter : public ImageStreamWriter {
+private:
+    FILE* file = nullptr;
+    int width = 0;
+    uint32_t index[64] = {};
+    uint32_t prev = 0xff000000u;  // opaque black, as the format specifies
+    int run = 0;
+    std::vector<uint8_t> bytes;
+
+    static void putBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+        out.push_back((uint8_t)(v >> 24));
+        out.push_back((uint8_t)(v >> 16));
+        out.push_back((uint8_t)(v >> 8));
+        out.push_back((uint8_t)v);
+    }
+
+    bool flush() {
+        bool ok = bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        bytes.clear();
+        return ok;
+    }
+
+public:
+    ~QoiStreamWriter() override {
+        if (file) fclose(file);
+    }
+
+    bool begin(const std::string& path, int w, int h) override {
+        file = fopen(path.c_str(), "wb");
+        if (!file) return false;
+        width = w;
+        bytes.insert(bytes.end(), {'q', 'o', 'i', 'f'});
+        putBigEndian(bytes, (uint32_t)w);
+        putBigEndian(bytes, (uint32_t)h);
+        bytes.push_back(4);  // RGBA
+        bytes.push_back(0);  // sRGB with linear alpha
+        return flush();
+    }
+
+    bool writeRows(const uint32_t* pixels, int rows) override {
+        size_t count = (size_t)rows * width;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t px = pixels[i];
+            if (px == prev) {
+                if (++run == 62) {
+                    bytes.push_back((uint8_t)(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                bytes.push_back((uint8_t)(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            int r = px & 0xff, g = (px >> 8) & 0xff, b = (px >> 16) & 0xff, a = px >> 24;
+            int slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+            if (index[slot] == px) {
+                bytes.push_back((uint8_t)slot);
+            } else {
+                index[slot] = px;
+                if ((px >> 24) == (prev >> 24)) {
+                    int8_t dr = (int8_t)(r - (int)(prev & 0xff));
+                    int8_t dg = (int8_t)(g - (int)((prev >> 8) & 0xff));
+                    int8_t db = (int8_t)(b - (int)((prev >> 16) & 0xff));
+                    int8_t drg = (int8_t)(dr - dg), dbg = (int8_t)(db - dg);
+                    if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                        bytes.push_back((uint8_t)(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                    } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                        bytes.push_back((uint8_t)(0x80 | (dg + 32)));
+                        bytes.push_back((uint8_t)(((drg + 8) << 4) | (dbg + 8)));
+                    } else {
+                        bytes.insert(bytes.end(), {0xfe, (uint8_t)r, (uint8_t)g, (uint8_t)b});
+                    }
+                } else {
+                    bytes.insert(bytes.end(), {0xff, (uint8_t)r, (uint8_t)g, (uint8_t)b, (uint8_t)a});
+                }
+            }
+            prev = px;
+        }
+        return flush();
+    }
+
+    bool end() override {
+        if (run > 0) bytes.push_back((uint8_t)(0xc0 | (run - 1)));
+        bytes.insert(bytes.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+        bool ok = flush();
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+// PngImageWriter class
+// stb_image_write compresses a PNG in one call, so the strips are gathered into a full
+// image first; very large exports should use .qoi instead
+class PngImageWriter : public ImageStreamWriter {
+private:
+    static const size_t MAX_PIXELS = (size_t)1 << 28;  // 1 GiB of RGBA
+
+    std::string path;
+    int width = 0, height = 0;
+    std::vector<uint32_t> pixels;
+
+public:
+    bool begin(const std::string& outputPath, int w, int h) override {
+        if ((size_t)w * h > MAX_PIXELS) {
+            std::cerr << "Image too large for PNG export, use a .qoi file" << std::endl;
+            return false;
+        }
+        path = outputPath;
+        width = w;
+        height = h;
+        pixels.reserve((size_t)w * h);
+        return true;
+    }
+
+    bool writeRows(const uint32_t* rows, int count) override {
+        pixels.insert(pixels.end(), rows, rows + (size_t)count * width);
+        return true;
+    }
+
+    bool end() override {
+        return stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4) != 0;
+    }
+};
+
+// Rasterizes strips on the calling thread while a background thread encodes the previous
+// strip, so encoding overlaps with rasterization
+bool ExportMazeImage(MazeRasterizer& raster, ImageStreamWriter& writer, const std::string& path, int stripRows) {
+    int imageW = raster.imageWidth();
+    int imageH = raster.imageHeight();
+    if (!writer.begin(path, imageW, imageH)) return false;
+
+    std::vector<uint32_t> strips[2];
+    int readyRows[2] = {0, 0};  // rows waiting to be encoded, 0 while the buffer is free
+    bool finished = false;
+    bool encoded = true;
+    std::mutex lock;
+    std::condition_variable changed;
+
+    std::thread encoder([&]() {
+        PROFILE_THREAD_NAME("image encoder");
+        for (int i = 0;; i ^= 1) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return readyRows[i] > 0 || finished; });
+            int rows = readyRows[i];
+            if (rows == 0) break;
+            guard.unlock();
+
+            PROFILE_SCOPE("writeRows");
+            bool ok = writer.writeRows(strips[i].data(), rows);
+
+            guard.lock();
+            encoded = encoded && ok;
+            readyRows[i] = 0;
+            changed.notify_all();
+        }
+    });
+
+    int i = 0;
+    for (int y0 = 0; y0 < imageH; y0 += stripRows, i ^= 1) {
+        int rows = std::min(stripRows, imageH - y0);
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return readyRows[i] == 0; });
+        }
+        strips[i].resize((size_t)stripRows * imageW);
+        {
+            PROFILE_SCOPE("renderStrip");
+            raster.renderStrip(y0, rows, strips[i].data());
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            readyRows[i] = rows;
+        }
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+    }
+    changed.notify_all();
+    encoder.join();
+
+    return writer.end() && encoded;
+}
+
+// RenderSnapshot struct
+// Everything DrawSnapshot needs for one PLAYING frame, copied out of the simulation so
+// the renderer never touches live game objects
+struct RenderSnapshot {
+    GameState state = GameState::PLAYING;
+    double publishTime = 0;
+    uint32_t mazeVersion = 0;
+    int mazeWidth = 0, mazeHeight = 0;
+    int cellSize = 0, offsetX = 0, offsetY = 0;
+    std::vector<uint8_t> openMasks;
+    int playerX = 0, playerY = 0, playerPrevX = 0, playerPrevY = 0;
+    std::vector<int16_t> enemyX, enemyY, enemyPrevX, enemyPrevY;
+    std::vector<int> weaponX, weaponY;
+    std::vector<std::pair<int, int>> path;
+    bool showPath = false;
+    float timer = 0;
+    int score = 0;
+    int power = 0;
+};
+
+// TripleBuffer class
+// Lock-free hand-off of the latest value from one writer thread to one reader thread.
+// The writer fills its back slot and swaps it with the middle one; the reader swaps the
+// middle slot to the front only when it holds something newer.
+template <typename T>
+class TripleBuffer {
+private:
+    static const int FRESH_BIT = 4;
+
+    T slots[3];
+    std::atomic<int> middle;  // slot index, with FRESH_BIT set while it is unread
+    int back;
+    int front;
+
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+
+    // Slots are recycled, so the writer must overwrite every field it cares about
+    T& writeSlot() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel) & 3;
+    }
+
+    const T& read() {
+        if (middle.load(std::memory_order_acquire) & FRESH_BIT) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        }
+        return slots[front];
+    }
+};
+
+// BackgroundFileWriter class
+// Writes files on a worker thread so the frame that asks for a save never waits on the disk.
+// Each file goes to a temporary name first and is renamed over the destination, so a crash
+// mid-write leaves the previous version intact.
+class BackgroundFileWriter {
+private:
+    struct Job {
+        std::string path;
+        std::vector<uint8_t> bytes;
+    };
+
+    std::vector<Job> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;  // signalled when a batch of writes is done
+    bool stopping = false;
+    bool writing = false;          // the worker holds jobs taken off the queue
+    std::thread worker;
+
+    void loop() {
+        PROFILE_THREAD_NAME("file writer");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;  // stopping, and everything is written
+            std::vector<Job> jobs;
+            jobs.swap(queue);
+            writing = true;
+            lock.unlock();
+            for (const Job& job : jobs) writeAtomically(job.path, job.bytes);
+            lock.lock();
+            writing = false;
+            idle.notify_all();
+        }
+    }
+
+    static bool writeAtomically(const std::string& path, const std::vector<uint8_t>& bytes) {
+        PROFILE_SCOPE("writeAtomically");
+        std::string temporaryPath = path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            if (!file.good()) {
+                std::cerr << "Could not write " << temporaryPath << std::endl;
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);  // replaces the old file in one step
+        if (error) {
+            std::cerr << "Could not replace " << path << ": " << error.message() << std::endl;
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+public:
+    BackgroundFileWriter() = default;
+    BackgroundFileWriter(const BackgroundFileWriter&) = delete;
+    BackgroundFileWriter& operator=(const BackgroundFileWriter&) = delete;
+
+    // Waits for queued writes to finish
+    ~BackgroundFileWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Waits until every write queued so far is on disk, for callers about to read the files
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && !writing; });
+    }
+
+    // A newer write to a path still waiting in the queue replaces the older one
+    void write(const std::string& path, std::vector<uint8_t> bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto queued = std::find_if(queue.begin(), queue.end(), [&](const Job& job) { return job.path == path; });
+            if (queued != queue.end()) {
+                queued->bytes.swap(bytes);
+            } else {
+                queue.push_back({path, std::move(bytes)});
+            }
+            if (!worker.joinable()) worker = std::thread(&BackgroundFileWriter::loop, this);
+        }
+        wake.notify_one();
+    }
+};
+
+// PcmRing class
+// Single-producer, single-consumer ring of interleaved 16-bit frames. The decoder thread
+// writes and the audio device thread reads; neither side ever blocks or allocates.
+class PcmRing {
+private:
+    std::vector<int16_t> samples;
+    size_t capacity = 0;  // in frames, a power of two
+    int channels = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> read{0};
+
+public:
+    void reset(size_t frames, int channelCount) {
+        capacity = frames;
+        channels = channelCount;
+        samples.assign(frames * channelCount, 0);
+        written.store(0, std::memory_order_relaxed);
+        read.store(0, std::memory_order_relaxed);
+    }
+
+    size_t freeFrames() const {
+        return capacity - (size_t)(written.load(std::memory_order_relaxed) - read.load(std::memory_order_acquire));
+    }
+
+    // Producer: contiguous space at the write position, at most 'wanted' frames
+    int16_t* writeSpan(size_t wanted, size_t& frames) {
+        uint64_t position = written.load(std::memory_order_relaxed);
+        size_t offset = (size_t)(position & (capacity - 1));
+        frames = std::min({ wanted, freeFrames(), capacity - offset });
+        return samples.data() + offset * channels;
+    }
+
+    void commit(size_t frames) {
+        written.store(written.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+    }
+
+    // Consumer: copies up to 'frames' frames out and returns how many there were
+    size_t pop(int16_t* out, size_t frames) {
+        uint64_t position = read.load(std::memory_order_relaxed);
+        size_t available = (size_t)(written.load(std::memory_order_acquire) - position);
+        size_t count = std::min(frames, available);
+        size_t offset = (size_t)(position & (capacity - 1));
+        size_t first = std::min(count, capacity - offset);
+        std::memcpy(out, samples.data() + offset * channels, first * channels * sizeof(int16_t));
+        std::memcpy(out + first * channels, samples.data(), (count - first) * channels * sizeof(int16_t));
+        read.store(position + count, std::memory_order_release);
+        return count;
+    }
+};
+
+// MusicStreamer class
+// Looping background music that does not depend on the main loop. A decoder thread keeps
+// a PcmRing topped up from the MP3 and raylib's audio callback drains it on the device
+// thread, so a long frame (InitializeGame, a large findPath) cannot starve the stream.
+// raylib's AudioCallback carries no user pointer, hence the single active instance.
+class MusicStreamer {
+private:
+    static const size_t RING_FRAMES = 1 << 15;  // ~0.7 s at 44.1 kHz
+    static const size_t DECODE_FRAMES = 4096;
+    static constexpr int IDLE_SLEEP_MS = 10;
+    static std::atomic<MusicStreamer*> active;
+
+    drmp3 decoder{};
+    bool opened = false;
+    AudioStream stream{};
+    PcmRing ring;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> underruns{0};
+    int emptyDecodes = 0;  // consecutive reads that returned no frames; decoder thread only once playing
+    std::thread worker;
+
+    static void fill(void* buffer, unsigned int frames) {
+        MusicStreamer* streamer = active.load(std::memory_order_acquire);
+        int16_t* out = (int16_t*)buffer;
+        size_t got = streamer ? streamer->ring.pop(out, frames) : 0;
+        if (got < frames) {
+            int channels = streamer ? (int)streamer->decoder.channels : 2;
+            std::memset(out + got * channels, 0, (frames - got) * channels * sizeof(int16_t));
+            if (streamer) streamer->underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool startStream() {
+        stream = LoadAudioStream(decoder.sampleRate, 16, decoder.channels);
+        if (!IsAudioStreamReady(stream)) {
+            drmp3_uninit(&decoder);
+            return false;
+        }
+        opened = true;
+        emptyDecodes = 0;
+        ring.reset(RING_FRAMES, (int)decoder.channels);
+        return true;
+    }
+
+    // False once the track has nothing left to loop: a read at the end of the track can
+    // come back empty, but a second one straight after seeking back to the start means
+    // the file is truncated, corrupt or has no frames at all
+    bool decodeChunk() {
+        PROFILE_SCOPE("DecodeMusic");
+        size_t frames = 0;
+        int16_t* span = ring.writeSpan(DECODE_FRAMES, frames);
+        size_t decoded = (size_t)drmp3_read_pcm_frames_s16(&decoder, frames, span);
+        if (decoded < frames) drmp3_seek_to_pcm_frame(&decoder, 0);  // loop, as raylib's Music does
+        ring.commit(decoded);
+        emptyDecodes = decoded == 0 ? emptyDecodes + 1 : 0;
+        return emptyDecodes < 2;
+    }
+
+    void decodeLoop() {
+        PROFILE_THREAD_NAME("Music decoder");
+        while (!stopping.load(std::memory_order_relaxed)) {
+            if (ring.freeFrames() < DECODE_FRAMES) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_SLEEP_MS));
+                continue;
+            }
+            if (!decodeChunk()) return;  // the stream plays silence from here on
+        }
+    }
+
+public:
+    MusicStreamer() = default;
+    MusicStreamer(const MusicStreamer&) = delete;
+    MusicStreamer& operator=(const MusicStreamer&) = delete;
+    ~MusicStreamer() { close(); }
+
+    // Needs the audio device open; false if the file cannot be decoded
+    bool open(const char* path) {
+        close();
+        if (!drmp3_init_file(&decoder, path, nullptr)) return false;
+        return startStream();
+    }
+
+    // Decodes straight out of 'data' (a packed asset), which must stay valid until close()
+    bool open(const unsigned char* data, size_t size) {
+        close();
+        if (!drmp3_init_memory(&decoder, data, size, nullptr)) return false;
+        return startStream();
+    }
+
+    void play() {
+        if (!opened || worker.joinable()) return;
+        decodeChunk();  // so the first callback already has something to play
+        stopping.store(false, std::memory_order_relaxed);
+        worker = std::thread(&MusicStreamer::decodeLoop, this);
+        active.store(this, std::memory_order_release);
+        SetAudioStreamCallback(stream, &MusicStreamer::fill);
+        PlayAudioStream(stream);
+    }
+
+    void setVolume(float volume) {
+        if (opened) SetAudioStreamVolume(stream, volume);
+    }
+
+    // Times the device asked for more audio than was decoded
+    uint64_t underrunCount() const { return underruns.load(std::memory_order_relaxed); }
+
+    void close() {
+        if (!opened) return;
+        StopAudioStream(stream);
+        UnloadAudioStream(stream);  // after this the device thread no longer calls fill
+        active.store(nullptr, std::memory_order_release);
+        stopping.store(true, std::memory_order_relaxed);
+        if (worker.joinable()) worker.join();
+        drmp3_uninit(&decoder);
+        opened = false;
+    }
+};
+
+std::atomic<MusicStreamer*> MusicStreamer::active{nullptr};
+
+const uint32_t SAVE_GAME_MAGIC = 0x56535a4d;  // "MZSV"
+const uint32_t SAVE_GAME_VERSION = 4;
+
+const uint32_t RECORDING_MAGIC = 0x50525a4d;  // "MZRP"
+const uint32_t RECORDING_VERSION = 8;
+
+// How a recorded session was set up before its first tick
+enum SessionStart : uint8_t {
+    SESSION_NEW = 0,      // InitializeGame from the level menu
+    SESSION_RESTART = 1,  // RestartLevel from the game over screen
+    SESSION_RESUMED = 2   // a saved game; the tick 0 keyframe holds the state
+};
+
+// SessionKeyframe struct
+// The state at the start of a recorded tick, with the rewind history as it stood then, so a
+// replay that seeks here can rewind past the keyframe just as the original run did
+struct SessionKeyframe {
+    uint64_t tick = 0;
+    std::vector<uint8_t> state;    // SaveState
+    std::vector<uint8_t> history;  // SnapshotHistory::serialize
+};
+
+// SessionRecording struct
+// One PLAYING session as its starting conditions plus every tick that had input, which is
+// enough to simulate it again exactly. Keyframes hold full states for fast seeking, and the
+// final hash tells whether a replay ended in the same state as the original.
+struct SessionRecording {
+    uint32_t seed = 0;
+    uint8_t character = 1;
+    uint8_t level = 1;
+    uint8_t start = SESSION_NEW;
+    int32_t totalScore = 0;
+    int32_t currentScore = 0;
+    int32_t rewindSeconds = 0;                          // the history window rewinds went through
+    int32_t spawnSpacing = 0;                           // the --spawn-spacing enemies were placed with
+    std::vector<std::pair<uint64_t, uint32_t>> inputs;  // tick, PlayingInput bits
+    std::vector<SessionKeyframe> keyframes;
+    uint64_t finalTick = 0;
+    uint64_t finalHash = 0;
+
+    bool save(const std::string& path) const {
+        std::vector<uint8_t> bytes;
+        StateWriter out(bytes);
+        out.put(RECORDING_MAGIC);
+        out.put(RECORDING_VERSION);
+        out.put(seed);
+        out.put(character);
+        out.put(level);
+        out.put(start);
+        out.put(totalScore);
+        out.put(currentScore);
+        out.put(rewindSeconds);
+        out.put(spawnSpacing);
+        out.putVarint(inputs.size());
+        uint64_t lastTick = 0;
+        for (const auto& input : inputs) {
+            out.putVarint(input.first - lastTick);  // ticks only grow, so deltas stay small
+            out.putVarint(input.second);
+            lastTick = input.first;
+        }
+        out.putVarint(keyframes.size());
+        for (const SessionKeyframe& keyframe : keyframes) {
+            out.put(keyframe.tick);
+            out.putArray(keyframe.state);
+            out.putArray(keyframe.history);
+        }
+        out.put(finalTick);
+        out.put(finalHash);
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        return file.good();
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        StateReader in(bytes.data(), bytes.size());
+        uint32_t magic = 0, version = 0;
+        if (!in.get(magic) || magic != RECORDING_MAGIC || !in.get(version) || version != RECORDING_VERSION) return false;
+        in.get(seed);
+        in.get(character);
+        in.get(level);
+        in.get(start);
+        in.get(totalScore);
+        in.get(currentScore);
+        in.get(rewindSeconds);
+        in.get(spawnSpacing);
+
+        uint64_t count = 0, tick = 0;
+        in.getVarint(count);
+        inputs.clear();
+        for (uint64_t i = 0; i < count && in.ok(); ++i) {
+            uint64_t delta = 0, input = 0;
+            in.getVarint(delta);
+            in.getVarint(input);
+            tick += delta;
+            inputs.push_back({tick, (uint32_t)input});
+        }
+        in.getVarint(count);
+        keyframes.clear();
+        for (uint64_t i = 0; i < count && in.ok(); ++i) {
+            keyframes.emplace_back();
+            in.get(keyframes.back().tick);
+            in.getArray(keyframes.back().state);
+            in.getArray(keyframes.back().history);
+        }
+        in.get(finalTick);
+        in.get(finalHash);
+        return in.ok();
+    }
+};
+
+const uint64_t KEYFRAME_INTERVAL_TICKS = 10 * SIMULATION_TICK_RATE;
+
+// A recording reserves its input log and keyframes for this many ticks when a session starts,
+// so recording allocates nothing during play until a session outlasts it. Keyframe buffers
+// past RECORDING_RESERVE_BYTES are left to grow when taken, which only huge mazes reach.
+const uint64_t RECORDING_RESERVE_TICKS = 10 * 60 * SIMULATION_TICK_RATE;
+const size_t RECORDING_RESERVE_BYTES = 64 << 20;
+
+// Command-line switches
+struct LaunchOptions {
+    bool threadedSimulation = false;  // --threaded-sim: gameplay ticks on its own thread
+    bool benchThreaded = false;       // --bench-threaded: measure sim and render rates
+    int simulationHz = SIMULATION_TICK_RATE;  // --sim-hz N, 0 runs the simulation uncapped
+    int renderFps = 60;                       // --fps N, 0 leaves the frame rate uncapped
+    bool headless = false;                    // --headless: no window, GPU or audio
+    int headlessLevels = 1000;                // --levels N
+    uint64_t maxTicks = 0;                    // --max-ticks N, 0 for no limit
+    int startLevel = 1;                       // --level N
+    std::string scriptPath;                   // --script FILE, autopilot when empty
+    unsigned int seed = 0;                    // --seed N, 0 seeds from the clock
+    std::string exportPath;                   // --export FILE.png|FILE.qoi: render a maze offline
+    int exportMazeSize = 0;                   // --maze-size N, 0 uses the --level size
+    int exportCellPx = 8;                     // --cell-px N
+    int exportWallPx = 2;                     // --wall-px N
+    int spawnSpacing = 0;                     // --spawn-spacing N: keep enemies N cells apart, 0 disables it;
+                                              // replays use the spacing they were recorded with
+    bool exportSolution = true;               // --no-path leaves out the solution
+    std::string recordPath = "last_session.replay";  // --record FILE: where played sessions are saved
+    std::string replayPath;                   // --replay FILE: re-simulate a session and check its hash
+    uint64_t seekTick = 0;                    // --seek TICK: stop the replay at this tick, via keyframes
+    int rewindSeconds = 5;                    // --rewind-seconds: history kept for rewinding, 0 disables it;
+                                              // replays use the window they were recorded with
+    std::string tracePath = "trace.json";     // --trace FILE: capture a trace from launch; F4 toggles capture
+    bool traceAtLaunch = false;
+    bool assertNoAllocations = false;         // --assert-no-alloc: headless runs fail if a steady tick allocates;
+                                              // their levels are recorded to --record, as played ones are
+    std::string benchJsonPath;                // --bench-json FILE: maze_bench results as JSON
+    std::string benchBaselinePath;            // --baseline FILE: earlier --bench-json output to compare with
+    double benchThresholdPercent = 10;        // --threshold PERCENT: slowdown that counts as a regression
+    std::string frameBenchPath;               // --frame-bench FILE: time real frames replaying a recorded session
+};
+
+// InputScript class
+// Tick-stamped key presses for headless runs, one "<tick> <KEY>[,KEY...]" line each,
+// with KEY one of UP, RIGHT, DOWN, LEFT, PATH, EXIT, REWIND. Lines starting with '#' are
+// comments. REWIND steps back one history snapshot per tick it is listed on, like holding
+// Backspace.
+class InputScript {
+private:
+    std::vector<std::pair<uint64_t, uint32_t>> events;  // sorted by tick
+    size_t cursor;
+
+public:
+    InputScript() : cursor(0) {}
+
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) return false;
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            uint64_t tick;
+            std::string keys;
+            if (!(fields >> tick >> keys)) continue;
+
+            uint32_t input = 0;
+            std::istringstream names(keys);
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                if (name == "UP") input |= INPUT_UP;
+                else if (name == "RIGHT") input |= INPUT_RIGHT;
+                else if (name == "DOWN") input |= INPUT_DOWN;
+                else if (name == "LEFT") input |= INPUT_LEFT;
+                else if (name == "PATH") input |= INPUT_TOGGLE_PATH;
+                else if (name == "EXIT") input |= INPUT_EXIT_TO_MENU;
+                else if (name == "REWIND") input |= INPUT_REWIND;
+            }
+            events.push_back({tick, input});
+        }
+        std::stable_sort(events.begin(), events.end(),
+            [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+        return true;
+    }
+
+    // Keys scheduled for this tick; ticks must be asked for in increasing order
+    uint32_t inputAt(uint64_t tick) {
+        uint32_t input = 0;
+        while (cursor < events.size() && events[cursor].first <= tick) {
+            input |= events[cursor].second;
+            cursor++;
+        }
+        return input;
+    }
+
+    bool finished() const { return cursor >= events.size(); }
+};
+
+double SecondsNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const double PROCESS_START_SECONDS = SecondsNow();  // for the startup time report
+
+struct BenchmarkResult {
+    std::string name;
+    double nsPerOp;
+    uint64_t ops;
+};
+
+// Times body(), which performs opsPerCall operations, in several repetitions of at least
+// 100 ms each and keeps the fastest, which is the least disturbed by the rest of the system
+template <typename Body>
+BenchmarkResult MeasureBenchmark(const std::string& name, uint64_t opsPerCall, Body body) {
+    const int repetitions = 5;
+    const double minimumSeconds = 0.1;
+    body();  // warm caches and let buffers reach their size
+    double best = 1e30;
+    uint64_t totalOps = 0;
+    for (int rep = 0; rep < repetitions; ++rep) {
+        uint64_t ops = 0;
+        double start = SecondsNow();
+        double elapsed = 0;
+        do {
+            body();
+            ops += opsPerCall;
+            elapsed = SecondsNow() - start;
+        } while (elapsed < minimumSeconds);
+        best = std::min(best, elapsed * 1e9 / ops);
+        totalOps += ops;
+    }
+    std::cout << name << "  " << best << " ns/op" << std::endl;
+    return {name, best, totalOps};
+}
+
+bool WriteBenchmarkJson(const std::string& path, const std::vector<BenchmarkResult>& results) {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file << "{\"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        file << "  {\"name\": \"" << results[i].name << "\", \"ns_per_op\": " << results[i].nsPerOp
+             << ", \"ops\": " << results[i].ops << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "]}\n";
+    return file.good();
+}
+
+// Reads back the name and ns_per_op pairs of a file written by WriteBenchmarkJson
+bool ReadBenchmarkJson(const std::string& path, std::vector<std::pair<std::string, double>>& results) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::string nameKey = "\"name\": \"";
+    const std::string timeKey = "\"ns_per_op\": ";
+    for (size_t at = text.find(nameKey); at != std::string::npos; at = text.find(nameKey, at)) {
+        at += nameKey.size();
+        size_t nameEnd = text.find('"', at);
+        size_t time = text.find(timeKey, nameEnd);
+        if (nameEnd == std::string::npos || time == std::string::npos) return false;
+        results.push_back({text.substr(at, nameEnd - at), strtod(text.c_str() + time + timeKey.size(), nullptr)});
+    }
+    return true;
+}
+
+// Writes results as JSON with --bench-json and, with --baseline, fails when any of them is
+// slower than the stored value by more than --threshold percent
+int ReportBenchmarks(const std::vector<BenchmarkResult>& results, const LaunchOptions& options) {
+    if (!options.benchJsonPath.empty() && !WriteBenchmarkJson(options.benchJsonPath, results)) {
+        std::cerr << "Could not write " << options.benchJsonPath << std::endl;
+        return 1;
+    }
+    if (options.benchBaselinePath.empty()) return 0;
+
+    std::vector<std::pair<std::string, double>> baseline;
+    if (!ReadBenchmarkJson(options.benchBaselinePath, baseline)) {
+        std::cerr << "Cannot read benchmark baseline " << options.benchBaselinePath << std::endl;
+        return 1;
+    }
+    int regressions = 0;
+    std::cout << "\nagainst " << options.benchBaselinePath << " (threshold " << options.benchThresholdPercent << "%)" << std::endl;
+    for (const BenchmarkResult& result : results) {
+        auto stored = std::find_if(baseline.begin(), baseline.end(),
+            [&](const std::pair<std::string, double>& entry) { return entry.first == result.name; });
+        if (stored == baseline.end() || stored->second <= 0) {
+            std::cout << result.name << "  no baseline" << std::endl;
+            continue;
+        }
+        double change = (result.nsPerOp / stored->second - 1) * 100;
+        bool regressed = change > options.benchThresholdPercent;
+        regressions += regressed;
+        std::cout << result.name << "  " << stored->second << " -> " << result.nsPerOp << " ns/op  "
+                  << (change >= 0 ? "+" : "") << change << "%" << (regressed ? "  REGRESSED" : "") << std::endl;
+    }
+    if (regressions > 0) {
+        std::cerr << regressions << " benchmark(s) regressed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Game class
+
+class Game {
+private:
+    GameState state;
+    int totalScore;
+    Maze* maze;
+    Player* player;
+    EnemySwarm enemies;
+    WeaponPool weapons;
+    TimerWheel timers;
+    std::vector<TimerEvent> firedTimers;
+    std::vector<int> dueEnemies;  // ids of the enemies whose move timers fired this tick
+    SpawnPlacer spawns;
+    OccupancyGrid enemyGrid;
+    OccupancyGrid weaponGrid;
+    std::vector<int> cellScratch;
+    Level* level;
+
+    // Maze, player and level live in levelArena and are dropped together when the level
+    // changes; per-tick temporaries such as search buffers come from scratchArena
+    Arena levelArena;
+    Arena scratchArena;
+    std::vector<std::pair<int, int>> pathScratch;
+    std::vector<int> highScores;
+    static int currentScore;
+    float timer;
+    float tickAccumulator;
+    uint32_t pendingInput;
+    bool gameOver;
+    bool enemiesRelocate = false;
+    bool showPath; // Added member variable
+
+    Texture2D player1Texture;
+    Texture2D player2Texture;
+    Texture2D player3Texture;
+    AssetArchive assetArchive;  // outlives everything decoded from it, including the music stream
+    Texture2D starWarsBackground;
+    Texture2D mazeBackground;
+    Texture2D startTexture;
+    Texture2D endTexture;
+    Texture2D weaponTexture;
+    Texture2D enemyTexture;
+    MusicStreamer backgroundMusic;
+    bool isPlaying;
+
+    // Text baked once in BakeText; only the numbers and high scores are ever re-laid out
+    NumberGlyphs hudDigits;
+    CachedNumber hudTime, hudScore, hudPower;
+    BakedText hudTimeLabel, hudScoreLabel, hudPowerLabel, hudPathHint, hudExitHint;
+    BakedText titleText, subtitleText, startLabel, exitLabel, resumeLabel, highScoreTitle;
+    BakedText highScoreLines[3];
+    BakedText characterTitle, levelTitle, easyLabel, mediumLabel, hardLabel;
+    BakedText gameOverText, gameOverHint, victoryText, victoryHint;
+
+    int selectedCharacter;
+    int selectedLevel;
+
+    // Threaded simulation: the sim thread owns every field above while it runs
+    LaunchOptions options;
+    std::thread simulationThread;
+    std::atomic<bool> stopSimulation{false};
+    std::atomic<uint32_t> sharedInput{0};
+    std::atomic<uint64_t> simulatedTicks{0};
+    TripleBuffer<RenderSnapshot> snapshots;
+    uint32_t mazeVersion = 0;
+
+    // Recording of the session in progress
+    SessionRecording recording;
+    bool recordingSession = false;
+    uint64_t sessionTick = 0;
+    std::vector<SessionKeyframe> keyframePool;  // buffers of earlier recordings' keyframes, for reuse
+
+    // Saved games go to disk on this writer's thread
+    BackgroundFileWriter saveWriter;
+    bool savedGameAvailable = false;
+    bool writePlayerFiles;  // saved game and high scores; off for simulated and benchmark runs
+
+    // Session that stands in for the keyboard and clock during RunFrameBenchmark
+    const SessionRecording* drivingSession = nullptr;
+    uint64_t drivenTick = 0;
+    size_t drivenInput = 0;
+
+    // Recent ticks for rewinding (hold Backspace while playing)
+    SnapshotHistory history;
+    std::vector<uint8_t> historyScratch;
+
+public:
+    Game(const LaunchOptions& launchOptions = LaunchOptions())
+        : state(GameState::FIRST_SCREEN), totalScore(0), maze(nullptr), player(nullptr), level(nullptr),
+             timer(0), tickAccumulator(0), pendingInput(0), gameOver(false), selectedCharacter(0), selectedLevel(0), showPath(false),
+             options(launchOptions) {
+        if (options.traceAtLaunch) PROFILE_TRACE_BEGIN(options.tracePath);
+        SeedGameRandom(options.seed != 0 ? options.seed : (uint32_t)time(nullptr));
+        history = SnapshotHistory(options.rewindSeconds * SIMULATION_TICK_RATE);
+        writePlayerFiles = !options.headless;
+        savedGameAvailable = writePlayerFiles && std::filesystem::exists(SAVE_GAME_PATH);
+        if (!options.headless) {
+            LoadResources();  // opens the audio device too
+            backgroundMusic.play();
+        }
+        LoadScores();
+    }
+
+    ~Game() {
+        if (state == GameState::PLAYING) SaveGame();  // closing the window keeps the level
+        if (recordingSession) EndSession();
+        if (!options.headless) {
+            UnloadResources();
+            CloseAudioDevice();
+        }
+        PROFILE_END_FRAME();
+        PROFILE_TRACE_END();
+    }
+
+    // Menus and end screens wait for events instead of redrawing at the frame rate; the last
+    // frame stays on screen until input or a state change gives a reason to draw another
+    void Run() {
+        bool redraw = true;
+        while (!WindowShouldClose()) {
+            if (options.threadedSimulation && state == GameState::PLAYING) {
+                SetEventWaiting(false);
+                RunPlayingThreaded(0);
+                redraw = true;
+                continue;
+            }
+            {
+                PROFILE_SCOPE("Frame");
+                GameState before = state;
+                Update();
+                bool idle = IsStaticState(state);
+                SetEventWaiting(idle);
+                redraw = redraw || !idle || state != before || HadScreenInput();
+                if (redraw) {
+                    Draw();
+                    redraw = false;
+                    if (!startupReported) ReportStartup();
+                } else {
+                    PollInputEvents();  // sleeps until input; music plays on its own thread
+                }
+            }
+            PROFILE_END_FRAME();
+        }
+        SetEventWaiting(false);
+    }
+
+    // Plays hard levels for a few seconds per configuration and reports the achieved
+    // simulation and render rates, showing that each follows its own limit
+    void RunThreadedBenchmark() {
+        struct Phase { int simHz; int fps; };
+        const Phase phases[] = {{60, 60}, {60, 240}, {240, 60}, {240, 30}, {0, 60}, {0, 0}};
+        const double phaseSeconds = 3.0;
+
+        selectedCharacter = 1;
+        std::cout << "sim_hz_target  fps_target  sim_hz  fps" << std::endl;
+        for (const Phase& phase : phases) {
+            options.simulationHz = phase.simHz;
+            SetTargetFPS(phase.fps);
+
+            uint64_t ticks = 0, frames = 0;
+            double start = SecondsNow();
+            double elapsed = 0;
+            while (elapsed < phaseSeconds && !WindowShouldClose()) {
+                if (state != GameState::PLAYING) {
+                    selectedLevel = 3;
+                    InitializeGame();
+                }
+                simulatedTicks = 0;
+                frames += RunPlayingThreaded(phaseSeconds - elapsed);
+                ticks += simulatedTicks;
+                elapsed = SecondsNow() - start;
+            }
+            std::cout << phase.simHz << "  " << phase.fps << "  "
+                      << ticks / elapsed << "  " << frames / elapsed << std::endl;
+        }
+        SetTargetFPS(options.renderFps);
+    }
+
+    // Plays levels back to back without a window, audio or textures, as fast as the CPU
+    // allows. Input comes from --script, or else from an autopilot that walks the shortest
+    // path to the exit. Returns non-zero if the script could not be loaded.
+    int RunHeadless() {
+        InputScript script;
+        bool scripted = !options.scriptPath.empty();
+        if (scripted && !script.load(options.scriptPath)) {
+            std::cerr << "Cannot read input script " << options.scriptPath << std::endl;
+            return 1;
+        }
+
+        // --assert-no-alloc plays every level as a recorded session, as the menus start them,
+        // so the ticks it checks also write the input log and keyframes
+        bool recorded = options.assertNoAllocations;
+        auto startLevel = [&](SessionStart start) {
+            if (start == SESSION_NEW) selectedLevel = options.startLevel;
+            if (recorded) {
+                BeginSession(start);
+            } else if (start == SESSION_NEW) {
+                InitializeGame();
+            } else {
+                RestartLevel();
+            }
+        };
+
+        selectedCharacter = 1;
+        startLevel(SESSION_NEW);
+
+        uint64_t ticks = 0;
+        int levelsFinished = 0, victories = 0, gameOvers = 0;
+        uint32_t levelVersion = mazeVersion;
+        uint64_t levelTicks = 0;
+        double start = SecondsNow();
+        while (levelsFinished < options.headlessLevels && (options.maxTicks == 0 || ticks < options.maxTicks)) {
+            uint32_t input = scripted ? script.inputAt(ticks) : AutopilotInput();
+            if (levelVersion != mazeVersion) {
+                levelVersion = mazeVersion;
+                levelTicks = 0;
+            }
+            uint32_t versionBefore = mazeVersion;
+#ifdef MAZE_ALLOC_TRACKING
+            {
+                // Past the warm-up, a tick that stays in its level must not touch the heap
+                AllocationGuard guard;
+                SimulateTick(input);
+                const AllocationViolation& violation = guard.violation();
+                bool withinReserve = !recordingSession || sessionTick <= RECORDING_RESERVE_TICKS;  // it grows after that
+                if (options.assertNoAllocations && violation.calls > 0 && levelTicks >= ALLOCATION_WARMUP_TICKS &&
+                    mazeVersion == versionBefore && state == GameState::PLAYING && withinReserve) {
+                    std::cerr << "Tick " << ticks << " allocated " << violation.calls << " times in steady state, first "
+                              << violation.firstBytes << " bytes in " << (violation.firstScope ? violation.firstScope : "an unscoped call")
+                              << std::endl;
+                    return 1;
+                }
+            }
+#else
+            SimulateTick(input);
+#endif
+            ticks++;
+            levelTicks++;
+            PROFILE_COUNTER("enemies", enemies.size());
+            PROFILE_END_FRAME();  // a tick is the headless frame
+
+            if (mazeVersion != versionBefore) {
+                levelsFinished++;  // cleared a level and moved on to the next one
+            } else if (state == GameState::VICTORY) {
+                levelsFinished++;
+                victories++;
+                startLevel(SESSION_NEW);
+            } else if (state == GameState::GAME_OVER) {
+                levelsFinished++;
+                gameOvers++;
+                startLevel(SESSION_RESTART);
+            } else if (state != GameState::PLAYING) {
+                levelsFinished++;
+                startLevel(SESSION_NEW);
+            }
+        }
+        double seconds = std::max(SecondsNow() - start, 1e-9);
+
+        std::cout << "levels " << levelsFinished << "  ticks " << ticks
+                  << "  victories " << victories << "  game_overs " << gameOvers
+                  << "  seconds " << seconds
+                  << "  levels/s " << levelsFinished / seconds
+                  << "  ticks/s " << ticks / seconds << std::endl;
+        return 0;
+    }
+
+    // Generates one level of the requested size and writes it as an image without a GPU:
+    // walls, the solution from findPath and the spawned entities
+    int RunExport() {
+        selectedLevel = options.startLevel;
+        levelArena.reset();
+        level = levelArena.make<Level>(selectedLevel);
+        int mazeSize = options.exportMazeSize > 0 ? options.exportMazeSize : level->getMazeSize();
+
+        maze = levelArena.make<Maze>(levelArena, mazeSize, mazeSize, options.exportCellPx);
+        maze->generate();
+        mazeVersion++;
+        enemies.clear();
+        timers.reset();
+        weapons.clear();
+        enemyGrid.reset(mazeSize, mazeSize);
+        weaponGrid.reset(mazeSize, mazeSize);
+        GenerateWeaponsAndEnemies();
+        spawns.release();
+
+        int cellPx = std::max(2, options.exportCellPx);
+        int wallPx = std::min(std::max(1, options.exportWallPx), cellPx - 1);
+        MazeRasterizer raster(maze->getOpenMasks(), mazeSize, mazeSize, cellPx, wallPx);
+        if (options.exportSolution) {
+            maze->findPath(0, 0, mazeSize - 1, mazeSize - 1, scratchArena, pathScratch);
+            raster.addPath(pathScratch, YELLOW);
+        }
+        int inset = (cellPx - wallPx) / 6;
+        for (const Weapon& weapon : weapons) raster.addCellMarker(weapon.getX(), weapon.getY(), inset, SKYBLUE);
+        for (int id = 0; id < (int)enemies.size(); ++id) raster.addCellMarker(enemies.getX(id), enemies.getY(id), inset, RED);
+        raster.addCellMarker(0, 0, inset, GREEN);
+        raster.addCellMarker(mazeSize - 1, mazeSize - 1, inset, GOLD);
+        raster.finishOverlays();
+
+        const std::string& path = options.exportPath;
+        bool qoi = path.size() >= 4 && path.compare(path.size() - 4, 4, ".qoi") == 0;
+        QoiStreamWriter qoiWriter;
+        PngImageWriter pngWriter;
+        ImageStreamWriter& writer = qoi ? (ImageStreamWriter&)qoiWriter : (ImageStreamWriter&)pngWriter;
+
+        double start = SecondsNow();
+        if (!ExportMazeImage(raster, writer, path, 256)) {
+            std::cerr << "Failed to export " << path << std::endl;
+            return 1;
+        }
+        std::cout << "exported " << path << "  " << raster.imageWidth() << "x" << raster.imageHeight()
+                  << "  seconds " << SecondsNow() - start << std::endl;
+        return 0;
+    }
+
+    // Re-simulates a recorded session without rendering. Keyframes are checked on the way, and
+    // the run fails if the state ever differs from the recording. With --seek it jumps to the
+    // nearest keyframe before that tick, rewind history included, and simulates only the rest.
+    int RunReplay() {
+        SessionRecording session;
+        if (!session.load(options.replayPath)) {
+            std::cerr << "Cannot read session recording " << options.replayPath << std::endl;
+            return 1;
+        }
+        StartRecordedSession(session);
+
+        bool seeking = options.seekTick > 0;
+        uint64_t stopTick = seeking ? std::min(options.seekTick, session.finalTick) : session.finalTick;
+        uint64_t tick = 0;
+        size_t nextKeyframe = 0;
+        if (seeking) {
+            while (nextKeyframe + 1 < session.keyframes.size() && session.keyframes[nextKeyframe + 1].tick <= stopTick) {
+                nextKeyframe++;
+            }
+            if (nextKeyframe < session.keyframes.size()) {
+                const SessionKeyframe& keyframe = session.keyframes[nextKeyframe];
+                StateReader historyIn(keyframe.history.data(), keyframe.history.size());
+                if (!LoadState(keyframe.state.data(), keyframe.state.size()) || !history.deserialize(historyIn)) {
+                    std::cerr << "Corrupt keyframe at tick " << keyframe.tick << std::endl;
+                    return 1;
+                }
+                tick = keyframe.tick;
+            }
+        }
+        size_t nextInput = 0;
+        while (nextInput < session.inputs.size() && session.inputs[nextInput].first < tick) nextInput++;
+
+        std::vector<uint8_t> stateBytes;
+        std::vector<uint8_t> historyBytes;
+        double start = SecondsNow();
+        uint64_t firstTick = tick;
+        while (tick < stopTick) {
+            if (nextKeyframe < session.keyframes.size() && session.keyframes[nextKeyframe].tick == tick) {
+                const SessionKeyframe& expected = session.keyframes[nextKeyframe];
+                SaveState(stateBytes);
+                historyBytes.clear();
+                StateWriter historyOut(historyBytes);
+                history.serialize(historyOut);
+                if (stateBytes != expected.state || historyBytes != expected.history) {
+                    std::cerr << "Replay diverged before tick " << tick << std::endl;
+                    return 1;
+                }
+                nextKeyframe++;
+            }
+            uint32_t input = 0;
+            while (nextInput < session.inputs.size() && session.inputs[nextInput].first == tick) {
+                input |= session.inputs[nextInput++].second;
+            }
+            SimulateTick(input);
+            tick++;
+            PROFILE_END_FRAME();
+            if (state != GameState::PLAYING && tick < session.finalTick) {
+                std::cerr << "Replay left PLAYING early, at tick " << tick << " of " << session.finalTick << std::endl;
+                return 1;
+            }
+        }
+        double seconds = std::max(SecondsNow() - start, 1e-9);
+
+        uint64_t hash = StateHash();
+        std::cout << "replayed ticks " << firstTick << ".." << tick << "  ticks/s " << (tick - firstTick) / seconds
+                  << "  state_hash " << std::hex << hash << std::dec << std::endl;
+        if (!seeking && hash != session.finalHash) {
+            std::cerr << "Final state hash mismatch: expected " << std::hex << session.finalHash << std::dec << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+#ifdef MAZE_BENCHMARKS
+    // Floods the maze from (0, 0) through its open masks and checks that the reachability
+    // index gives the same answer for every cell
+    bool ReachabilityIndexAgrees() const {
+        const int dx[] = {0, 1, 0, -1};
+        const int dy[] = {-1, 0, 1, 0};
+        int width = maze->getWidth(), height = maze->getHeight();
+        std::vector<uint8_t> seen((size_t)width * height, 0);
+        std::vector<int> queue = {0};
+        seen[0] = 1;
+        for (size_t head = 0; head < queue.size(); ++head) {
+            int x = queue[head] % width, y = queue[head] / width;
+            for (int d = 0; d < 4; ++d) {
+                int next = (y + dy[d]) * width + x + dx[d];
+                if (maze->canMove(x, y, d) && !seen[next]) {
+                    seen[next] = 1;
+                    queue.push_back(next);
+                }
+            }
+        }
+        for (int cell = 0; cell < width * height; ++cell) {
+            if (maze->reachable(0, 0, cell % width, cell / width) != (seen[cell] != 0)) return false;
+        }
+        return true;
+    }
+
+    // The maze_bench target. Times the core operations with a fixed seed, prints and
+    // optionally writes the results as JSON (--bench-json), and with --baseline fails when
+    // any result is slower than the stored one by more than --threshold percent.
+    int RunBenchmarks() {
+        std::vector<BenchmarkResult> results;
+        volatile size_t sink = 0;  // keeps results observable so nothing is optimised away
+
+        for (int size : {16, 64, 256, 1024}) {
+            Arena arena;
+            results.push_back(MeasureBenchmark("generate/" + std::to_string(size), 1, [&]() {
+                arena.reset();
+                Maze* generated = arena.make<Maze>(arena, size, size, 1);
+                generated->generate();
+                scratchArena.reset();
+                sink = sink + generated->getOpenMasks()[0];
+            }));
+        }
+
+        // 64 is small enough for the reachability index, 512 is searched without it
+        for (int size : {64, 512}) {
+            levelArena.reset();
+            maze = levelArena.make<Maze>(levelArena, size, size, 1);
+            maze->generate();
+            std::vector<std::pair<int, int>> starts, shortEnds;
+            for (int i = 0; i < 256; ++i) {
+                int x = GameRandom() % size, y = GameRandom() % size;
+                starts.push_back({x, y});
+                shortEnds.push_back({std::min(size - 1, x + 3), std::min(size - 1, y + 3)});
+            }
+            size_t query = 0;
+            results.push_back(MeasureBenchmark("findPath/short/" + std::to_string(size), 1, [&]() {
+                query = (query + 1) % starts.size();
+                maze->findPath(starts[query].first, starts[query].second, shortEnds[query].first, shortEnds[query].second,
+                               scratchArena, pathScratch);
+                scratchArena.reset();
+                sink = sink + pathScratch.size();
+            }));
+            results.push_back(MeasureBenchmark("findPath/long/" + std::to_string(size), 1, [&]() {
+                maze->findPath(0, 0, size - 1, size - 1, scratchArena, pathScratch);
+                scratchArena.reset();
+                sink = sink + pathScratch.size();
+            }));
+            // A walled-in exit: answered by the index without searching, where there is one
+            maze->setWall(size - 1, size - 1, 0, true);
+            maze->setWall(size - 1, size - 1, 3, true);
+            results.push_back(MeasureBenchmark("findPath/unreachable/" + std::to_string(size), 1, [&]() {
+                maze->findPath(0, 0, size - 1, size - 1, scratchArena, pathScratch);
+                scratchArena.reset();
+                sink = sink + pathScratch.size();
+            }));
+
+            // The index must follow wall edits: compare it with a flood fill while the exit is
+            // walled in, once it is reopened, and through a run of random closes and reopens
+            if (maze->hasReachabilityIndex()) {
+                bool agrees = !maze->exitReachable() && ReachabilityIndexAgrees();
+                maze->setWall(size - 1, size - 1, 0, false);
+                maze->setWall(size - 1, size - 1, 3, false);
+                agrees = agrees && maze->exitReachable() && ReachabilityIndexAgrees();
+                for (int i = 0; i < 256 && agrees; ++i) {
+                    int x = GameRandom() % size, y = GameRandom() % size, d = GameRandom() % 4;
+                    maze->setWall(x, y, d, maze->canMove(x, y, d));
+                    agrees = ReachabilityIndexAgrees();
+                }
+                if (!agrees) {
+                    std::cerr << "Reachability index disagrees with the walls after setWall" << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+        {
+            const int size = 256;
+            const uint64_t steps = 1 << 16;
+            levelArena.reset();
+            maze = levelArena.make<Maze>(levelArena, size, size, 1);
+            maze->generate();
+            const int dx[] = {0, 1, 0, -1};
+            const int dy[] = {-1, 0, 1, 0};
+            int x = 0, y = 0;
+            uint32_t rng = 12345;
+            results.push_back(MeasureBenchmark("canMove/walk/" + std::to_string(size), steps, [&]() {
+                for (uint64_t i = 0; i < steps; ++i) {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 17;
+                    rng ^= rng << 5;
+                    int d = rng & 3;
+                    if (maze->canMove(x, y, d)) {
+                        x += dx[d];
+                        y += dy[d];
+                    }
+                }
+                sink = sink + x + y;
+            }));
+        }
+
+        // One wander step of a million enemies, with each kernel this CPU can run; ns/op is
+        // per enemy, so under 1 means the whole swarm steps in under a millisecond
+        {
+            const int size = 1024;
+            const size_t count = 1000000;
+            levelArena.reset();
+            maze = levelArena.make<Maze>(levelArena, size, size, 1);
+            maze->generate();
+            std::vector<int16_t> xs(count), ys(count);
+            for (size_t i = 0; i < count; ++i) {
+                xs[i] = (int16_t)(GameRandom() % size);
+                ys[i] = (int16_t)(GameRandom() % size);
+            }
+            const WanderKernel widest = wanderKernel;
+            for (WanderKernel kernel : {WanderKernel::SCALAR, WanderKernel::AVX2, WanderKernel::AVX512}) {
+                if (kernel > widest) break;
+                wanderKernel = kernel;
+                uint64_t tick = 0;
+                std::string name = std::string("StepWanderers/") + WanderKernelName(kernel) + "/" + std::to_string(count);
+                results.push_back(MeasureBenchmark(name, count, [&]() {
+                    StepWanderers(maze->getOpenMasks(), size, size, xs.data(), ys.data(), WanderKey(1, tick++), count);
+                    sink = sink + xs[0];
+                }));
+            }
+            wanderKernel = widest;
+        }
+
+        // A 2048² maze at the --export settings used for the largest images; ns/op is per pixel
+        {
+            const int size = 2048;
+            const int stripRows = 256;
+            levelArena.reset();
+            maze = levelArena.make<Maze>(levelArena, size, size, 1);
+            maze->generate();
+            const WanderKernel widest = wanderKernel;
+            for (WanderKernel kernel : {WanderKernel::SCALAR, WanderKernel::AVX2}) {
+                if (kernel > widest) break;
+                wanderKernel = kernel;
+                MazeRasterizer raster(maze->getOpenMasks(), size, size, 2, 1);
+                raster.finishOverlays();
+                std::vector<uint32_t> strip((size_t)stripRows * raster.imageWidth());
+                uint64_t pixels = (uint64_t)raster.imageWidth() * raster.imageHeight();
+                std::string name = std::string("renderStrip/") + WanderKernelName(kernel) + "/" + std::to_string(size);
+                results.push_back(MeasureBenchmark(name, pixels, [&]() {
+                    raster.finishOverlays();
+                    for (int y0 = 0; y0 < raster.imageHeight(); y0 += stripRows) {
+                        raster.renderStrip(y0, std::min(stripRows, raster.imageHeight() - y0), strip.data());
+                    }
+                    sink = sink + strip[0];
+                }));
+            }
+            wanderKernel = widest;
+        }
+
+        // The player wanders a maze with 'count' enemies and weapons at one per 16 cells;
+        // whatever it collects or defeats respawns elsewhere so the count stays put
+        for (int count : {16, 1024, 65536}) {
+            const int steps = 1024;
+            int size = std::max(8, (int)std::ceil(std::sqrt(16.0 * count)));
+            levelArena.reset();
+            level = levelArena.make<Level>(1);
+            maze = levelArena.make<Maze>(levelArena, size, size, 1);
+            maze->generate();
+            player = levelArena.make<Player>(levelArena, 0, 0, Texture2D{}, maze);
+            enemies.clear();
+            weapons.clear();
+            enemyGrid.reset(size, size);
+            weaponGrid.reset(size, size);
+            spawns.prepare(*maze, 0, 0, 1, [](int, int) { return true; });
+            int x, y;
+            for (int i = 0; i < count && spawns.take(x, y); ++i) weaponGrid.insert(weapons.add(x, y, maze, weaponTexture), x, y);
+            for (int i = 0; i < count && spawns.take(x, y); ++i) enemyGrid.insert(enemies.add(x, y), x, y);
+
+            const int dx[] = {0, 1, 0, -1};
+            const int dy[] = {-1, 0, 1, 0};
+            results.push_back(MeasureBenchmark("CheckCollisions/" + std::to_string(count), steps, [&]() {
+                for (int i = 0; i < steps; ++i) {
+                    int d = GameRandom() & 3;
+                    if (maze->canMove(player->getX(), player->getY(), d)) player->move(dx[d], dy[d]);
+                    CheckCollisions();
+                    state = GameState::PLAYING;
+                    while ((int)weapons.size() < count || (int)enemies.size() < count) {
+                        int rx = GameRandom() % size, ry = GameRandom() % size;
+                        if (!weaponGrid.empty(rx, ry) || !enemyGrid.empty(rx, ry)) continue;
+                        if ((int)weapons.size() < count) {
+                            weaponGrid.insert(weapons.add(rx, ry, maze, weaponTexture), rx, ry);
+                        } else {
+                            enemyGrid.insert(enemies.add(rx, ry), rx, ry);
+                        }
+                    }
+                }
+                sink = sink + player->getScore();
+            }));
+            results.push_back(MeasureBenchmark("nearest/" + std::to_string(count), steps, [&]() {
+                for (int i = 0; i < steps; ++i) {
+                    sink = sink + enemyGrid.nearest(GameRandom() % size, GameRandom() % size, 8);
+                }
+            }));
+        }
+
+        // In-memory only: headless games never write highscores.txt
+        results.push_back(MeasureBenchmark("UpdateHighScores", 1, [&]() {
+            UpdateHighScores(GameRandom() % 100000);
+            sink = sink + highScores[0];
+        }));
+
+        return ReportBenchmarks(results, options);
+    }
+#endif
+
+    // Replays a recorded session through the real Update and Draw, one tick per frame, into
+    // an offscreen render texture with no frame limit or vsync, and reports the frame-time
+    // distribution. MAZE_PROFILER builds also list the scopes of the slowest frames. Results
+    // go through the same --bench-json / --baseline handling as maze_bench.
+    int RunFrameBenchmark() {
+        const size_t WORST_FRAMES = 5;
+        SessionRecording session;
+        if (!session.load(options.frameBenchPath)) {
+            std::cerr << "Cannot read session recording " << options.frameBenchPath << std::endl;
+            return 1;
+        }
+        writePlayerFiles = false;
+        backgroundMusic.setVolume(0.0f);
+        RenderTexture2D target = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
+
+        StartRecordedSession(session);
+        drivingSession = &session;
+        drivenTick = 0;
+        drivenInput = 0;
+
+        struct SlowFrame {
+            double ms;
+            uint64_t frame;
+#ifdef MAZE_PROFILER
+            std::vector<ProfileEvent> scopes;
+#endif
+        };
+        std::vector<double> frameMs;
+        std::vector<SlowFrame> slowest;
+#ifdef MAZE_PROFILER
+        std::vector<ProfileEvent> frameScopes;
+        uint32_t ownThread = Profiler::instance().threadRing().threadIndex;
+        Profiler::instance().drain([](uint32_t, const ProfileEvent&) {});  // setup is not a frame
+#endif
+        while (drivenTick < session.finalTick && state == GameState::PLAYING) {
+            double start = SecondsNow();
+            {
+                PROFILE_SCOPE("Frame");
+                Update();
+                BeginTextureMode(target);
+                DrawScene();
+                // Draw calls only queue GPU work. Flush the batch and read one pixel back
+                // while the target is bound, so the clock stops after the GPU has drawn it.
+                rlDrawRenderBatchActive();
+                MemFree(rlReadScreenPixels(1, 1));
+                EndTextureMode();
+            }
+            double ms = (SecondsNow() - start) * 1e3;
+            PollInputEvents();  // keeps the hidden window responsive
+            frameMs.push_back(ms);
+
+#ifdef MAZE_PROFILER
+            frameScopes.clear();
+            Profiler::instance().drain([&](uint32_t thread, const ProfileEvent& event) {
+                if (thread == ownThread) frameScopes.push_back(event);
+            });
+#endif
+            auto fastest = std::min_element(slowest.begin(), slowest.end(),
+                [](const SlowFrame& a, const SlowFrame& b) { return a.ms < b.ms; });
+            if (slowest.size() < WORST_FRAMES || ms > fastest->ms) {
+                if (slowest.size() == WORST_FRAMES) slowest.erase(fastest);
+#ifdef MAZE_PROFILER
+                slowest.push_back({ms, frameMs.size() - 1, frameScopes});
+#else
+                slowest.push_back({ms, frameMs.size() - 1});
+#endif
+            }
+        }
+        bool complete = drivenTick == session.finalTick;
+        bool matches = complete && StateHash() == session.finalHash;
+        drivingSession = nullptr;
+        UnloadRenderTexture(target);
+        ExitToMainMenu();
+
+        if (frameMs.empty()) {
+            std::cerr << "The recording has no frames to play" << std::endl;
+            return 1;
+        }
+        if (!matches) {
+            std::cerr << "Replay diverged from the recording; frame times are not comparable" << std::endl;
+            return 1;
+        }
+
+        std::vector<double> sorted = frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) { return sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * p / 100))]; };
+        double mean = 0;
+        for (double ms : frameMs) mean += ms;
+        mean /= frameMs.size();
+
+        std::cout << "frames " << frameMs.size() << "  mean " << mean << " ms  p50 " << percentile(50) << " ms  p95 "
+                  << percentile(95) << " ms  p99 " << percentile(99) << " ms  max " << sorted.back() << " ms" << std::endl;
+        std::cout << "music underruns " << backgroundMusic.underrunCount() << std::endl;
+
+        std::sort(slowest.begin(), slowest.end(), [](const SlowFrame& a, const SlowFrame& b) { return a.ms > b.ms; });
+        for (const SlowFrame& frame : slowest) {
+            std::cout << "\nframe " << frame.frame << "  " << frame.ms << " ms" << std::endl;
+#ifdef MAZE_PROFILER
+            std::vector<ProfileEvent> scopes = frame.scopes;
+            std::sort(scopes.begin(), scopes.end(), [](const ProfileEvent& a, const ProfileEvent& b) {
+                return a.startNs != b.startNs ? a.startNs < b.startNs : a.depth < b.depth;
+            });
+            for (const ProfileEvent& scope : scopes) {
+                std::cout << std::string(2 + 2 * scope.depth, ' ') << scope.name << "  " << (scope.endNs - scope.startNs) / 1e6 << " ms"
+                          << std::endl;
+            }
+#else
+            std::cout << "  (build with MAZE_PROFILER for the scopes of each frame)" << std::endl;
+#endif
+        }
 
-    void draw() const {
-        int cellSize = maze->getCellSize();
-        int offsetX = maze->getOffsetX();
-        int offsetY = maze->getOffsetY();
-        float scale = (float)(cellSize * 0.8) / std::max(texture.width, texture.height);
-        float adjustedX = x * cellSize + offsetX + (cellSize - texture.width * scale) / 2;
-        float adjustedY = y * cellSize + offsetY + (cellSize - texture.height * scale) / 2;
-        DrawTextureEx(texture, {adjustedX, adjustedY}, 0, scale, WHITE);
+        std::vector<BenchmarkResult> results = {
+            {"frame/mean", mean * 1e6, frameMs.size()},
+            {"frame/p50", percentile(50) * 1e6, frameMs.size()},
+            {"frame/p95", percentile(95) * 1e6, frameMs.size()},
+            {"frame/p99", percentile(99) * 1e6, frameMs.size()},
+            {"frame/max", sorted.back() * 1e6, frameMs.size()},
+        };
+        return ReportBenchmarks(results, options);
     }
 
-    void collectWeapon() {
-        power += 10;
-        weaponsCollected++;
+private:
+    bool eventWaiting = false;
+    double assetLoadSeconds = 0;
+    bool startupReported = false;
+
+    void ReportStartup() {
+        startupReported = true;
+        std::cout << "Startup: first interactive frame after " << (SecondsNow() - PROCESS_START_SECONDS) * 1e3
+                  << " ms (assets " << assetLoadSeconds * 1e3 << " ms from "
+                  << (assetArchive.isOpen() ? "assets.pak" : "loose files") << ")" << std::endl;
     }
 
-    void hitEnemy() {
-        power -= 10;
-        if (power < 0) power = 0;
+    // States whose screen changes only in response to input
+    static bool IsStaticState(GameState gameState) {
+        return gameState != GameState::PLAYING;
     }
 
-    void addScore(int points) {
-        score += points;
+    void SetEventWaiting(bool on) {
+        if (on == eventWaiting) return;
+        eventWaiting = on;
+        if (on) {
+            EnableEventWaiting();
+        } else {
+            DisableEventWaiting();
+        }
     }
 
-    int getX() const { return x; }
-    int getY() const { return y; }
-    int getPower() const { return power; }
-    int getScore() const { return score; }
-    int getWeaponsCollected() const { return weaponsCollected; }
-
-    void setPath(const std::vector<std::pair<int, int>>& path) { // Added method
-        currentPath = path;
+    // Anything since the last poll that could change a static screen
+    bool HadScreenInput() {
+        bool focused = IsWindowFocused();
+        bool focusChanged = focused != windowWasFocused;
+        windowWasFocused = focused;
+        return focusChanged || GetKeyPressed() != 0 || IsWindowResized() || GetMouseWheelMove() != 0 ||
+               IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || IsMouseButtonReleased(MOUSE_BUTTON_LEFT) ||
+               IsMouseButtonPressed(MOUSE_BUTTON_RIGHT);
     }
+    bool windowWasFocused = true;
+
+    std::vector<std::pair<int, int>> autopilotPath;
+    size_t autopilotStep = 0;
+    uint32_t autopilotMazeVersion = 0;
+
+    // One key press per tick along the shortest path from the player to the exit
+    uint32_t AutopilotInput() {
+        int x = player->getX();
+        int y = player->getY();
+        if (autopilotMazeVersion != mazeVersion || autopilotStep >= autopilotPath.size() ||
+            autopilotPath[autopilotStep] != std::make_pair(x, y)) {
+            maze->findPath(x, y, maze->getWidth() - 1, maze->getHeight() - 1, scratchArena, autopilotPath);
+            autopilotStep = 0;
+            autopilotMazeVersion = mazeVersion;
+        }
+        if (autopilotStep + 1 >= autopilotPath.size()) return 0;
 
-    const std::vector<std::pair<int, int>>& getPath() const { // Added method
-        return currentPath;
+        std::pair<int, int> next = autopilotPath[++autopilotStep];
+        if (next.second < y) return INPUT_UP;
+        if (next.first > x) return INPUT_RIGHT;
+        if (next.second > y) return INPUT_DOWN;
+        return INPUT_LEFT;
     }
 
-    void clearPath() { // Added method
-        currentPath.clear();
-    }
-};
+    // Runs the PLAYING state with the simulation on its own thread while this (the raylib)
+    // thread samples input and draws the newest snapshot. Returns the number of frames drawn
+    // once the level loop leaves PLAYING, the window closes or maxSeconds (if > 0) pass.
+    uint64_t RunPlayingThreaded(double maxSeconds) {
+        CaptureSnapshot(snapshots.writeSlot());
+        snapshots.publish();
+        stopSimulation = false;
+        sharedInput = 0;
+        simulationThread = std::thread(&Game::SimulationLoop, this);
+
+        uint64_t frames = 0;
+        double start = SecondsNow();
+        bool playing = true;
+        while (playing && !WindowShouldClose()) {
+            PROFILE_END_FRAME();
+            PROFILE_SCOPE("Frame");
+            sharedInput.fetch_or(ReadPlayingKeys());
+            if (IsKeyPressed(KEY_F4)) PROFILE_TRACE_TOGGLE(options.tracePath);
+
+            const RenderSnapshot& snapshot = snapshots.read();
+            PROFILE_COUNTER("enemies", snapshot.enemyX.size());
+            PROFILE_COUNTER("weapons", snapshot.weaponX.size());
+            float alpha = 1.0f;
+            if (options.simulationHz > 0) {
+                alpha = std::min(1.0f, (float)((SecondsNow() - snapshot.publishTime) * options.simulationHz));
+            }
+            BeginDrawing();
+            ClearBackground(RAYWHITE);
+            DrawSnapshot(snapshot, alpha);
+            PROFILE_DRAW_OVERLAY();
+            {
+                PROFILE_SCOPE("EndDrawing");
+                EndDrawing();
+            }
+            frames++;
 
-// Enemy class
-class Enemy {
-private:
-    int x, y;
-    int health;
-    float moveTimer;
-    const Maze* maze;
-    Texture2D texture;
+            playing = snapshot.state == GameState::PLAYING;
+            if (maxSeconds > 0 && SecondsNow() - start >= maxSeconds) break;
+        }
 
-public:
-    Enemy(int startX, int startY, const Maze* m, Texture2D enemyTexture) 
-        : x(startX), y(startY), health(10), moveTimer(0), maze(m), texture(enemyTexture) {}
+        stopSimulation = true;
+        simulationThread.join();
+        return frames;
+    }
 
-    void draw() const {
-        int cellSize = maze->getCellSize();
-        int offsetX = maze->getOffsetX();
-        int offsetY = maze->getOffsetY();
-        float scale = (float)(cellSize * 0.8) / std::max(texture.width, texture.height);
-        float adjustedX = x * cellSize + offsetX + (cellSize - texture.width * scale) / 2;
-        float adjustedY = y * cellSize + offsetY + (cellSize - texture.height * scale) / 2;
-        DrawTextureEx(texture, {adjustedX, adjustedY}, 0, scale, WHITE);
-    }
-
-    void move(const Maze& maze) {
-        moveTimer += GetFrameTime();
-        if (moveTimer >= ENEMY_MOVE_INTERVAL) {
-            moveTimer = 0;
-            std::vector<int> possibleMoves;
-            if (this->maze->canMove(x, y, 0)) possibleMoves.push_back(0);
-            if (this->maze->canMove(x, y, 1)) possibleMoves.push_back(1);
-            if (this->maze->canMove(x, y, 2)) possibleMoves.push_back(2);
-            if (this->maze->canMove(x, y, 3)) possibleMoves.push_back(3);
-
-            if (!possibleMoves.empty()) {
-                int move = possibleMoves[rand() % possibleMoves.size()];
-                switch (move) {
-                    case 0: y--; break;
-                    case 1: x++; break;
-                    case 2: y++; break;
-                    case 3: x--; break;
-                }
+    void SimulationLoop() {
+        PROFILE_THREAD_NAME("simulation");
+        using Clock = std::chrono::steady_clock;
+        Clock::duration tickDuration = Clock::duration::zero();
+        if (options.simulationHz > 0) {
+            tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.simulationHz));
+        }
+        Clock::time_point nextTick = Clock::now();
+
+        while (!stopSimulation.load(std::memory_order_relaxed)) {
+            SimulateTick(sharedInput.exchange(0));
+            simulatedTicks.fetch_add(1, std::memory_order_relaxed);
+            CaptureSnapshot(snapshots.writeSlot());
+            snapshots.publish();
+            if (state != GameState::PLAYING) break;
+
+            if (options.simulationHz > 0) {
+                nextTick += tickDuration;
+                Clock::time_point now = Clock::now();
+                // Fell far behind: drop the backlog rather than running a burst of ticks
+                if (now - nextTick > tickDuration * MAX_TICKS_PER_FRAME) nextTick = now;
+                std::this_thread::sleep_until(nextTick);
             }
         }
     }
 
-    bool isAlive() const { return health > 0; }
-    int getX() const { return x; }
-    int getY() const { return y; }
-    void setX(int x) { this->x = x; }
-    void setY(int y) { this->y = y; }
-    int getHealth() const { return health; }
-    void damage(int amount) { health -= amount; }
-};
-
-// Weapon class
-class Weapon {
-private:
-    int x, y;
-    const Maze* maze;
-    Texture2D texture;
-
-public:
-    Weapon(int startX, int startY, const Maze* m, Texture2D weaponTexture) 
-        : x(startX), y(startY), maze(m), texture(weaponTexture) {}
-
-    void draw() const {
-        int cellSize = maze->getCellSize();
-        int offsetX = maze->getOffsetX();
-        int offsetY = maze->getOffsetY();
-        float scale = (float)(cellSize * 0.6) / std::max(texture.width, texture.height);
-        float adjustedX = x * cellSize + offsetX + (cellSize - texture.width * scale) / 2;
-        float adjustedY = y * cellSize + offsetY + (cellSize - texture.height * scale) / 2;
-        DrawTextureEx(texture, {adjustedX, adjustedY}, 0, scale, WHITE);
+    void CaptureSnapshot(RenderSnapshot& out) {
+        PROFILE_SCOPE("CaptureSnapshot");
+        out.state = state;
+        out.publishTime = SecondsNow();
+        if (!maze || !player) return;
+
+        if (out.mazeVersion != mazeVersion) {
+            out.mazeVersion = mazeVersion;
+            out.mazeWidth = maze->getWidth();
+            out.mazeHeight = maze->getHeight();
+            out.cellSize = maze->getCellSize();
+            out.offsetX = maze->getOffsetX();
+            out.offsetY = maze->getOffsetY();
+            out.openMasks.assign(maze->getOpenMasks(), maze->getOpenMasks() + out.mazeWidth * out.mazeHeight);
+        }
+        out.playerX = player->getX();
+        out.playerY = player->getY();
+        out.playerPrevX = player->getPrevX();
+        out.playerPrevY = player->getPrevY();
+        out.enemyX = enemies.getXs();
+        out.enemyY = enemies.getYs();
+        out.enemyPrevX = enemies.getPrevXs();
+        out.enemyPrevY = enemies.getPrevYs();
+        out.weaponX.resize(weapons.size());
+        out.weaponY.resize(weapons.size());
+        for (size_t i = 0; i < weapons.size(); ++i) {
+            out.weaponX[i] = weapons[i].getX();
+            out.weaponY[i] = weapons[i].getY();
+        }
+        out.showPath = showPath;
+        if (showPath) out.path.assign(player->getPath().begin(), player->getPath().end());
+        out.timer = timer;
+        out.score = player->getScore();
+        out.power = player->getPower();
     }
 
-    int getX() const { return x; }
-    int getY() const { return y; }
-};
+    void DrawSnapshot(const RenderSnapshot& snapshot, float alpha) {
+        PROFILE_SCOPE("DrawSnapshot");
+        DrawBackground(mazeBackground);
+        if (snapshot.openMasks.empty()) return;
 
-// Level class
-class Level {
-private:
-    int difficulty;
-    int mazeSize;
+        int cellSize = snapshot.cellSize;
+        int offsetX = snapshot.offsetX;
+        int offsetY = snapshot.offsetY;
+        DrawMazeWalls(snapshot.openMasks.data(), snapshot.mazeWidth, snapshot.mazeHeight, cellSize, offsetX, offsetY);
+        DrawSpriteInCell(startTexture, 0, 0, cellSize, offsetX, offsetY, 0.8f);
+        DrawSpriteInCell(endTexture, snapshot.mazeWidth - 1, snapshot.mazeHeight - 1, cellSize, offsetX, offsetY, 0.8f);
 
-public:
-    Level(int diff) : difficulty(diff) {
-        switch (difficulty) {
-            case 1: mazeSize = 10; break;
-            case 2: mazeSize = 15; break;
-            case 3: mazeSize = 20; break;
-            default: mazeSize = 10; break;
+        for (size_t i = 0; i < snapshot.weaponX.size(); ++i) {
+            DrawSpriteInCell(weaponTexture, snapshot.weaponX[i], snapshot.weaponY[i], cellSize, offsetX, offsetY, 0.6f);
         }
-    }
-
-    int getMazeSize() const { return mazeSize; }
-};
+        for (size_t i = 0; i < snapshot.enemyX.size(); ++i) {
+            float drawX = snapshot.enemyPrevX[i] + (snapshot.enemyX[i] - snapshot.enemyPrevX[i]) * alpha;
+            float drawY = snapshot.enemyPrevY[i] + (snapshot.enemyY[i] - snapshot.enemyPrevY[i]) * alpha;
+            DrawSpriteInCell(enemyTexture, drawX, drawY, cellSize, offsetX, offsetY, 0.8f);
+        }
+        float playerX = snapshot.playerPrevX + (snapshot.playerX - snapshot.playerPrevX) * alpha;
+        float playerY = snapshot.playerPrevY + (snapshot.playerY - snapshot.playerPrevY) * alpha;
+        DrawSpriteInCell(GetPlayerTexture(), playerX, playerY, cellSize, offsetX, offsetY, 0.8f);
 
-// Game class
+        DrawHud(snapshot.timer, snapshot.score, snapshot.power);
+        if (snapshot.showPath) {
+            DrawPathLine(snapshot.path, cellSize, offsetX, offsetY);
+        }
+    }
 
-class Game {
-private:
-    GameState state;
-    int totalScore;
-    Maze* maze;
-    Player* player;
-    std::vector<Enemy> enemies;
-    std::vector<Weapon> weapons;
-    Level* level;
-    std::vector<int> highScores;
-    static int currentScore;
-    float timer;
-    bool gameOver;
-    bool enemiesRelocate = false;
-    bool showPath; // Added member variable
+    // Assets come from assets.pak next to the executable when it is there, so startup is
+    // one open and one mapping and does not depend on the working directory; anything not
+    // packed falls back to the loose file under src/. Images decode in parallel on worker
+    // threads while the main thread opens the audio device, uploads each image as it lands
+    // and keeps a loading screen up.
+    void LoadResources() {
+        PROFILE_SCOPE("LoadResources");
+        double start = SecondsNow();
+        assetArchive.open(TextFormat("%sassets.pak", GetApplicationDirectory()));
+        struct TextureAsset {
+            Texture2D* texture;
+            const char* path;
+            bool background;  // pre-scaled to the window on the worker
+        };
+        const TextureAsset assets[] = {
+            { &starWarsBackground, "src/star_wars.png", true },
+            { &mazeBackground, "src/starwars.png", true },
+            { &player1Texture, "src/player1.png", false },
+            { &player2Texture, "src/player2.png", false },
+            { &player3Texture, "src/player3.png", false },
+            { &startTexture, "src/start.png", false },
+            { &endTexture, "src/end.png", false },
+            { &weaponTexture, "src/weapon.png", false },
+            { &enemyTexture, "src/enemy.png", false },
+        };
+        const size_t assetCount = std::size(assets);
+
+        ImageBatchLoader loader(assetArchive);
+        for (const TextureAsset& asset : assets) {
+            loader.add(asset.path, asset.background ? SCREEN_WIDTH : 0, asset.background ? SCREEN_HEIGHT : 0);
+        }
+        loader.start();
 
-    Texture2D player1Texture;
-    Texture2D player2Texture;
-    Texture2D player3Texture;
-    Texture2D starWarsBackground;
-    Texture2D mazeBackground;
-    Texture2D startTexture;
-    Texture2D endTexture;
-    Texture2D weaponTexture;
-    Texture2D enemyTexture;
-    Music backgroundMusic;
-    bool isPlaying;
+        InitAudioDevice();
+        size_t musicSize = 0;
+        const unsigned char* packedMusic = assetArchive.find("src/music.mp3", musicSize);
+        if (packedMusic != nullptr) {
+            backgroundMusic.open(packedMusic, musicSize);
+        } else {
+            backgroundMusic.open("src/music.mp3");
+        }
 
-    int selectedCharacter;
-    int selectedLevel;
+        size_t uploaded = 0;
+        while (uploaded < assetCount) {
+            for (size_t i = 0; i < assetCount; ++i) {
+                Image image;
+                if (!loader.take(i, image)) continue;
+                PROFILE_SCOPE("UploadTexture");
+                *assets[i].texture = assets[i].background ? LoadBackgroundTexture(image) : LoadTextureFromImage(image);
+                UnloadImage(image);
+                ++uploaded;
+            }
+            if (uploaded < assetCount) DrawLoadingScreen((float)uploaded / assetCount);
+        }
+        loader.wait();
+        BakeText();
+        assetLoadSeconds = SecondsNow() - start;
+    }
 
-public:
-    Game() : state(GameState::FIRST_SCREEN), maze(nullptr), player(nullptr), level(nullptr),
-             timer(0), gameOver(false), selectedCharacter(0), selectedLevel(0), showPath(false) {
-        srand(time(nullptr));
-        InitAudioDevice();
-        LoadResources();
-        PlayMusicStream(backgroundMusic);
-        LoadScores();
+    void DrawLoadingScreen(float progress) {
+        BeginDrawing();
+        ClearBackground(BLACK);
+        const char* text = "Loading...";
+        DrawText(text, (SCREEN_WIDTH - MeasureText(text, 30)) / 2, SCREEN_HEIGHT / 2 - 40, 30, RAYWHITE);
+        int barWidth = 400;
+        int barX = (SCREEN_WIDTH - barWidth) / 2;
+        DrawRectangleLines(barX, SCREEN_HEIGHT / 2 + 10, barWidth, 20, GRAY);
+        DrawRectangle(barX + 2, SCREEN_HEIGHT / 2 + 12, (int)((barWidth - 4) * progress), 16, GOLD);
+        EndDrawing();
     }
 
-    ~Game() {
-        UnloadResources();
-        CloseAudioDevice();
+    void BakeText() {
+        hudDigits.load(30);
+        hudTime.init(hudDigits, 2);
+        hudScore.init(hudDigits, 0);
+        hudPower.init(hudDigits, 0);
+        hudTimeLabel.set("Time: ", 30);
+        hudScoreLabel.set("Score: ", 30);
+        hudPowerLabel.set("Power: ", 30);
+        hudPathHint.set("Press 'S' to show/hide path", 20);
+        hudExitHint.set("Press E to exit to main menu", 20);
+
+        titleText.set("Star Wars Maze", 70);
+        subtitleText.set("Navigate through the maze to win!", 30);
+        startLabel.set("Start", 30);
+        exitLabel.set("Exit", 30);
+        resumeLabel.set("Press R to resume your saved game", 20);
+        highScoreTitle.set("Highest Scores:", 30);
+
+        characterTitle.set("Choose Your Character", 50);
+        levelTitle.set("Choose Difficulty", 50);
+        easyLabel.set("Easy", 30);
+        mediumLabel.set("Medium", 30);
+        hardLabel.set("Hard", 30);
+
+        gameOverText.set("Game Over!", 40);
+        gameOverHint.set("Press SPACE to restart", 30);
+        victoryText.set("Victory!", 40);
+        victoryHint.set("Press SPACE to return to main menu", 30);
     }
 
-    void Run() {
-        while (!WindowShouldClose()) {
-            Update();
-            Draw();  
+    void UnloadText() {
+        hudDigits.unload();
+        for (BakedText* text : { &hudTimeLabel, &hudScoreLabel, &hudPowerLabel, &hudPathHint, &hudExitHint,
+                                 &titleText, &subtitleText, &startLabel, &exitLabel, &resumeLabel, &highScoreTitle,
+                                 &highScoreLines[0], &highScoreLines[1], &highScoreLines[2],
+                                 &characterTitle, &levelTitle, &easyLabel, &mediumLabel, &hardLabel,
+                                 &gameOverText, &gameOverHint, &victoryText, &victoryHint }) {
+            text->unload();
         }
     }
-private:
-    void LoadResources() {
-        player1Texture = LoadTexture("src/player1.png");
-        player2Texture = LoadTexture("src/player2.png");
-        player3Texture = LoadTexture("src/player3.png");
-        starWarsBackground = LoadTexture("src/star_wars.png");
-        startTexture = LoadTexture("src/start.png");
-        endTexture = LoadTexture("src/end.png");
-        weaponTexture = LoadTexture("src/weapon.png");
-        enemyTexture = LoadTexture("src/enemy.png");
-        backgroundMusic = LoadMusicStream("src/music.mp3");
-        mazeBackground = LoadTexture("src/starwars.png");
-    }
 
     void UnloadResources() {
         UnloadTexture(player1Texture);
@@ -478,11 +4782,15 @@ private:
         UnloadTexture(endTexture);
         UnloadTexture(weaponTexture);
         UnloadTexture(enemyTexture);
-        UnloadMusicStream(backgroundMusic);
+        backgroundMusic.close();
+        UnloadText();
+        assetArchive.close();
     }
 
     void Update() {
-        UpdateMusicStream(backgroundMusic);
+        PROFILE_SCOPE("Update");
+        if (IsKeyPressed(KEY_F4)) PROFILE_TRACE_TOGGLE(options.tracePath);
+        scratchArena.reset();
 
         switch (state) {
             case GameState::FIRST_SCREEN:
@@ -507,14 +4815,20 @@ private:
     }
 
     void Draw() {
+        PROFILE_SCOPE("Draw");
         BeginDrawing();
+        DrawScene();
+        PROFILE_DRAW_OVERLAY();
+        PROFILE_SCOPE("EndDrawing");  // includes waiting for the frame rate limit
+        EndDrawing();
+    }
+
+    // Everything in a frame for the current state, into whatever target is bound
+    void DrawScene() {
         ClearBackground(RAYWHITE);
 
-        // Draw background scaled to screen size
-        DrawTexturePro(starWarsBackground, 
-            Rectangle{ 0, 0, (float)starWarsBackground.width, (float)starWarsBackground.height },
-            Rectangle{ 0, 0, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT },
-            Vector2{ 0, 0 }, 0.0f, WHITE);
+        // One opaque background per state; PLAYING has its own
+        DrawBackground(state == GameState::PLAYING ? mazeBackground : starWarsBackground);
 
         switch (state) {
             case GameState::FIRST_SCREEN:
@@ -536,8 +4850,6 @@ private:
                 DrawVictory();
                 break;
         }
-
-        EndDrawing();
     }
 
     void UpdateFirstScreen() {
@@ -552,42 +4864,35 @@ private:
                 CloseWindow();
             }
         }
+        if (savedGameAvailable && IsKeyPressed(KEY_R)) {
+            ResumeSavedGame();
+        }
     }
 
     void DrawFirstScreen() {
-        const char* titleText = "Star Wars Maze";
-        int titleFontSize = 70;
-        int titleWidth = MeasureText(titleText, titleFontSize);
-        int titleX = (SCREEN_WIDTH - titleWidth) / 2;
-
-        DrawText(titleText, titleX, 100, titleFontSize, GOLD);
-
-        const char* subtitleText = "Navigate through the maze to win!";
-        int subtitleFontSize = 30;
-        int subtitleWidth = MeasureText(subtitleText, subtitleFontSize);
-        int subtitleX = (SCREEN_WIDTH - subtitleWidth) / 2;
-
-        DrawText(subtitleText, subtitleX, 200, subtitleFontSize, RAYWHITE);
+        titleText.drawCentered(SCREEN_WIDTH / 2, 100, GOLD);
+        subtitleText.drawCentered(SCREEN_WIDTH / 2, 200, RAYWHITE);
 
         int buttonWidth = 200, buttonHeight = 60;
         int buttonX = (SCREEN_WIDTH - buttonWidth) / 2;
         Rectangle startButton = {(float)buttonX, 280, (float)buttonWidth, (float)buttonHeight};
         DrawRectangleRounded(startButton, 0.2f, 10, DARKGREEN);
-        DrawText("Start", buttonX + (buttonWidth - MeasureText("Start", 30)) / 2, 295, 30, WHITE);
+        startLabel.drawCentered(buttonX + buttonWidth / 2, 295, WHITE);
 
         Rectangle exitButton = {(float)buttonX, 380, (float)buttonWidth, (float)buttonHeight};
         DrawRectangleRounded(exitButton, 0.2f, 10, MAROON);
-        DrawText("Exit", buttonX + (buttonWidth - MeasureText("Exit", 30)) / 2, 395, 30, WHITE);
+        exitLabel.drawCentered(buttonX + buttonWidth / 2, 395, WHITE);
 
-        const char* highScoreText = "Highest Scores:";
-        int highScoreFontSize = 30;
-        int highScoreX = (SCREEN_WIDTH - MeasureText(highScoreText, highScoreFontSize)) / 2;
-        DrawText(highScoreText, highScoreX, 500 , highScoreFontSize, GOLD);
+        if (savedGameAvailable) {
+            resumeLabel.drawCentered(SCREEN_WIDTH / 2, 455, LIGHTGRAY);
+        }
+
+        highScoreTitle.drawCentered(SCREEN_WIDTH / 2, 500, GOLD);
 
         for (int i = 0; i < 3; i++) {
-            const char* scoreText = TextFormat("%d. %d", i + 1, highScores[i]);
-            int scoreX = (SCREEN_WIDTH - MeasureText(scoreText, highScoreFontSize)) / 2;
-            DrawText(scoreText, scoreX, 530 + i * 40, highScoreFontSize, WHITE);
+            // Re-rasterized only when a high score changes
+            highScoreLines[i].set(TextFormat("%d. %d", i + 1, highScores[i]), 30);
+            highScoreLines[i].drawCentered(SCREEN_WIDTH / 2, 530 + i * 40, WHITE);
         }
     }
 
@@ -617,12 +4922,7 @@ private:
     }
 
     void DrawCharacterSelection() {
-        const char* titleText = "Choose Your Character";
-        int titleFontSize = 50;
-        int titleWidth = MeasureText(titleText, titleFontSize);
-        int titleX = (SCREEN_WIDTH - titleWidth) / 2;
-
-        DrawText(titleText, titleX, 100, titleFontSize, GOLD);
+        characterTitle.drawCentered(SCREEN_WIDTH / 2, 100, GOLD);
 
         int buttonWidth = 100, buttonHeight = 100;
         int imageSize = 40;
@@ -661,54 +4961,147 @@ private:
 
             if (CheckCollisionPointRec(mousePos, easyButton)) {
                 selectedLevel = 1;
-                InitializeGame();
+                BeginSession(SESSION_NEW);
             } else if (CheckCollisionPointRec(mousePos, mediumButton)) {
                 selectedLevel = 2;
-                InitializeGame();
+                BeginSession(SESSION_NEW);
             } else if (CheckCollisionPointRec(mousePos, hardButton)) {
                 selectedLevel = 3;
-                InitializeGame();
+                BeginSession(SESSION_NEW);
             }
         }
     }
 
     void DrawLevelSelection() {
-        const char* titleText = "Choose Difficulty";
-        int titleFontSize = 50;
-        int titleWidth = MeasureText(titleText, titleFontSize);
-        int titleX = (SCREEN_WIDTH - titleWidth) / 2;
-
-        DrawText(titleText, titleX, 100, titleFontSize, GOLD);
+        levelTitle.drawCentered(SCREEN_WIDTH / 2, 100, GOLD);
 
         int buttonWidth = 200, buttonHeight = 60;
         int buttonX = (SCREEN_WIDTH - buttonWidth) / 2;
 
         Rectangle easyButton = {(float)buttonX, 300, (float)buttonWidth, (float)buttonHeight};
         DrawRectangleRounded(easyButton, 0.2f, 10, DARKGREEN);
-        DrawText("Easy", buttonX + (buttonWidth - MeasureText("Easy", 30)) /2, 315, 30, WHITE);
+        easyLabel.drawCentered(buttonX + buttonWidth / 2, 315, WHITE);
 
         Rectangle mediumButton = {(float)buttonX, 400, (float)buttonWidth, (float)buttonHeight};
         DrawRectangleRounded(mediumButton, 0.2f, 10, ORANGE);
-        DrawText("Medium", buttonX + (buttonWidth - MeasureText("Medium", 30)) / 2, 415, 30, WHITE);
+        mediumLabel.drawCentered(buttonX + buttonWidth / 2, 415, WHITE);
 
         Rectangle hardButton = {(float)buttonX, 500, (float)buttonWidth, (float)buttonHeight};
         DrawRectangleRounded(hardButton, 0.2f, 10, MAROON);
-        DrawText("Hard", buttonX + (buttonWidth - MeasureText("Hard", 30)) / 2, 515, 30, WHITE);
+        hardLabel.drawCentered(buttonX + buttonWidth / 2, 515, WHITE);
     }
 
     void UpdatePlaying() {
+        PROFILE_SCOPE("UpdatePlaying");
+        if (drivingSession) {
+            // RunFrameBenchmark: the recording supplies exactly one tick per frame
+            const auto& inputs = drivingSession->inputs;
+            while (drivenInput < inputs.size() && inputs[drivenInput].first == drivenTick) pendingInput |= inputs[drivenInput++].second;
+            drivenTick++;
+            tickAccumulator += SIMULATION_DT;
+        } else {
+            // Latch key presses until the next tick consumes them
+            pendingInput |= ReadPlayingKeys();
+            tickAccumulator += GetFrameTime();
+        }
+        int ticks = 0;
+        while (tickAccumulator >= SIMULATION_DT) {
+            if (ticks == MAX_TICKS_PER_FRAME) {
+                tickAccumulator = 0;
+                break;
+            }
+            tickAccumulator -= SIMULATION_DT;
+            ticks++;
+
+            uint32_t input = pendingInput;
+            pendingInput = 0;
+            SimulateTick(input);
+            if (state != GameState::PLAYING) break;
+        }
+        PROFILE_COUNTER("ticks", ticks);
+        PROFILE_COUNTER("enemies", enemies.size());
+        PROFILE_COUNTER("weapons", weapons.size());
+    }
+
+    void SimulateTick(uint32_t input) {
+        PROFILE_SCOPE("SimulateTick");
+        scratchArena.reset();
+        if (recordingSession) {
+            if (sessionTick % KEYFRAME_INTERVAL_TICKS == 0) {
+                if (keyframePool.empty()) {
+                    recording.keyframes.emplace_back();
+                } else {
+                    recording.keyframes.push_back(std::move(keyframePool.back()));
+                    keyframePool.pop_back();
+                }
+                SessionKeyframe& keyframe = recording.keyframes.back();
+                keyframe.tick = sessionTick;
+                SaveState(keyframe.state);
+                keyframe.history.clear();
+                StateWriter historyOut(keyframe.history);
+                history.serialize(historyOut);
+            }
+            if (input != 0) recording.inputs.push_back({sessionTick, input});
+        }
+
+        if (history.empty()) CaptureHistory();
+        if (input & INPUT_REWIND) {
+            if (history.stepBack()) {
+                const std::vector<uint8_t>& previous = history.current();
+                LoadState(previous.data(), previous.size());
+            }
+        } else {
+            StepPlaying(input);
+            CaptureHistory();
+        }
+
+        if (recordingSession) {
+            sessionTick++;
+            if (state != GameState::PLAYING) EndSession();
+        }
+    }
+
+    void CaptureHistory() {
+        PROFILE_SCOPE("CaptureHistory");
+        if (options.rewindSeconds <= 0 || state != GameState::PLAYING) {
+            history.clear();
+            return;
+        }
+        SaveState(historyScratch);
+        history.push(historyScratch);
+    }
+
+    void StepPlaying(uint32_t input) {
+        player->beginTick();
         CheckAndRelocateNearbyEnemies();
-        timer += GetFrameTime();
+        timer += SIMULATION_DT;
 
         // Player movement
-        if (IsKeyPressed(KEY_UP) && maze->canMove(player->getX(), player->getY(), 0)) player->move(0, -1);
-        if (IsKeyPressed(KEY_RIGHT) && maze->canMove(player->getX(), player->getY(), 1)) player->move(1, 0);
-        if (IsKeyPressed(KEY_DOWN) && maze->canMove(player->getX(), player->getY(), 2)) player->move(0, 1);
-        if (IsKeyPressed(KEY_LEFT) && maze->canMove(player->getX(), player->getY(), 3)) player->move(-1, 0);
-
-        // Update enemies
-        for (auto& enemy : enemies) {
-            enemy.move(*maze);
+        if ((input & INPUT_UP) && maze->canMove(player->getX(), player->getY(), 0)) player->move(0, -1);
+        if ((input & INPUT_RIGHT) && maze->canMove(player->getX(), player->getY(), 1)) player->move(1, 0);
+        if ((input & INPUT_DOWN) && maze->canMove(player->getX(), player->getY(), 2)) player->move(0, 1);
+        if ((input & INPUT_LEFT) && maze->canMove(player->getX(), player->getY(), 3)) player->move(-1, 0);
+
+        // Update enemies: only those whose timers are due this tick
+        {
+            PROFILE_SCOPE("StepEnemies");
+            enemies.beginTick();
+            firedTimers.clear();
+            timers.advance(firedTimers);
+            dueEnemies.clear();
+            for (const TimerEvent& event : firedTimers) {
+                int id = enemies.indexOf(event.target);
+                if (id < 0) continue;  // defeated since it was scheduled
+                if (event.kind == TIMER_ENEMY_MOVE) dueEnemies.push_back(id);
+            }
+            enemies.step(dueEnemies, *maze, timers.currentTick());
+            // The grid and the wheel are updated in firing order, as the timers came due
+            for (const TimerEvent& event : firedTimers) {
+                int id = enemies.indexOf(event.target);
+                if (id < 0 || event.kind != TIMER_ENEMY_MOVE) continue;
+                enemyGrid.move(id, enemies.getX(id), enemies.getY(id));
+                timers.schedule(ENEMY_MOVE_TICKS, TIMER_ENEMY_MOVE, event.target);
+            }
         }
 
         // Check collisions
@@ -723,17 +5116,19 @@ private:
             }
         }
 
-        if (IsKeyPressed(KEY_S)) {
+        if (input & INPUT_TOGGLE_PATH) {
             showPath = !showPath;
             if (showPath) {
-                std::vector<std::pair<int, int>> path = maze->findPath(player->getX(), player->getY(), maze->getWidth() - 1, maze->getHeight() - 1);
-                player->setPath(path);
+                maze->findPath(player->getX(), player->getY(), maze->getWidth() - 1, maze->getHeight() - 1, scratchArena, pathScratch);
+                player->setPath(pathScratch);
             } else {
                 player->clearPath();
             }
         }
-        if (IsKeyPressed(KEY_E)) {
+        if (input & INPUT_EXIT_TO_MENU) {
+            SaveGame();
             ExitToMainMenu();
+            return;
         }
         //increase level 
         if (player->getX() == maze->getWidth() - 1 && player->getY() == maze->getHeight() - 1) {
@@ -750,41 +5145,57 @@ private:
     }
 
     void DrawPlaying() {
-        DrawTexturePro(mazeBackground, 
-        Rectangle{ 0, 0, (float)mazeBackground.width, (float)mazeBackground.height },
-        Rectangle{ 0, 0, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT },
-        Vector2{ 0, 0 }, 0.0f, WHITE);
-
         maze->draw();
-        for (const auto& weapon : weapons) {
-            weapon.draw();
+        {
+            PROFILE_SCOPE("DrawWeapons");
+            for (const auto& weapon : weapons) {
+                weapon.draw();
+            }
         }
-        for (const auto& enemy : enemies) {
-            enemy.draw();
+        // Fraction of a tick elapsed since the last simulation step
+        float alpha = tickAccumulator / SIMULATION_DT;
+        {
+            PROFILE_SCOPE("DrawEnemies");
+            enemies.draw(*maze, enemyTexture, alpha);
         }
-        player->draw();
+        player->draw(alpha);
 
-        DrawRectangle(0, 0, SCREEN_WIDTH, 50, Fade(BLACK, 0.5f));
-        DrawText(TextFormat("Time: %.2f", timer), 10, 10, 30, WHITE);
-        DrawText(TextFormat("Score: %d", player->getScore()), 200, 10, 30, WHITE);
-        DrawText(TextFormat("Power: %d", player->getPower()), 400, 10, 30, WHITE);
-        DrawText("Press 'S' to show/hide path", 600, 10, 20, YELLOW); // Added line
-        DrawText("Press E to exit to main menu", 10, SCREEN_HEIGHT - 30, 20, YELLOW);
+        DrawHud(timer, player->getScore(), player->getPower());
         // Draw the path
         if (showPath) {
             maze->drawPath(player->getPath());
         }
     }
 
+    void DrawHud(float time, int score, int power) {
+        PROFILE_SCOPE("DrawHud");
+        PROFILE_DRAWS(1);
+        DrawRectangle(0, 0, SCREEN_WIDTH, 50, Fade(BLACK, 0.5f));
+        hudTime.set(time);
+        hudScore.set(score);
+        hudPower.set(power);
+        DrawLabelledNumber(hudTimeLabel, hudTime, 10, 10, WHITE);
+        DrawLabelledNumber(hudScoreLabel, hudScore, 200, 10, WHITE);
+        DrawLabelledNumber(hudPowerLabel, hudPower, 400, 10, WHITE);
+        hudPathHint.draw(600, 10, YELLOW);
+        hudExitHint.draw(10, SCREEN_HEIGHT - 30, YELLOW);
+    }
+
+    // "Label: number" laid out the way DrawText would lay out the whole string
+    void DrawLabelledNumber(const BakedText& label, const CachedNumber& number, int x, int y, Color tint) {
+        label.draw(x, y, tint);
+        number.draw(x + label.width() + hudDigits.glyphSpacing(), y, tint);
+    }
+
     void UpdateGameOver() {
         if (IsKeyPressed(KEY_SPACE)) {
-            RestartLevel();
+            BeginSession(SESSION_RESTART);
         }
     }
 
     void DrawGameOver() {
-        DrawText("Game Over!", SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, 40, RED);
-        DrawText("Press SPACE to restart", SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT / 2 + 20, 30, WHITE);
+        gameOverText.draw(SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 30, RED);
+        gameOverHint.draw(SCREEN_WIDTH / 2 - 150, SCREEN_HEIGHT / 2 + 20, WHITE);
     }
 
     void UpdateVictory() {
@@ -794,84 +5205,395 @@ private:
     }
 
     void DrawVictory() {
-        DrawText("Victory!", SCREEN_WIDTH / 2 - 80, SCREEN_HEIGHT / 2 - 30, 40, GREEN);
-        DrawText(TextFormat("Score: %d", player->getScore()), SCREEN_WIDTH / 2 - 70, SCREEN_HEIGHT / 2 + 20, 30, WHITE);
-        DrawText("Press SPACE to return to main menu", SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 + 70, 30, WHITE);
+        victoryText.draw(SCREEN_WIDTH / 2 - 80, SCREEN_HEIGHT / 2 - 30, GREEN);
+        hudScore.set(player->getScore());
+        DrawLabelledNumber(hudScoreLabel, hudScore, SCREEN_WIDTH / 2 - 70, SCREEN_HEIGHT / 2 + 20, WHITE);
+        victoryHint.draw(SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 + 70, WHITE);
     }
 
     void CheckCollisions() {
+        PROFILE_SCOPE("CheckCollisions");
         int playerX = player->getX();
         int playerY = player->getY();
 
-        // Check weapon collisions
-        weapons.erase(std::remove_if(weapons.begin(), weapons.end(),
-            [this, playerX, playerY](const Weapon& weapon) {
-                if (weapon.getX() == playerX && weapon.getY() == playerY) {
-                    player->collectWeapon();
-                    return true;
-                }
-                return false;
-            }), weapons.end());
-
-        // Check enemy collisions
-        for (auto& enemy : enemies) {
-            if (enemy.getX() == playerX && enemy.getY() == playerY) {
-                if (player->getPower() >= 10) {  // Changed from player->getPower() > enemy.getHealth()
-                    player->addScore(100);
-                    enemy.damage(enemy.getHealth());
-                    player->hitEnemy();  // Decrease player's power by 10
-                } else {
-                    player->hitEnemy();  // Decrease player's power by 10
-                    if (player->getPower() <= 0) {
-                        state = GameState::GAME_OVER;
-                        return;
-                    }
+        // A cell's list order depends on how things moved in, which LoadState does not
+        // restore, so everything here goes by id instead; otherwise a --seek would diverge
+
+        // Check weapon collisions, highest id first so swap-and-pop never moves a pending one
+        cellScratch.clear();
+        for (int id = weaponGrid.first(playerX, playerY); id != -1; id = weaponGrid.next(id)) {
+            cellScratch.push_back(id);
+        }
+        std::sort(cellScratch.begin(), cellScratch.end(), std::greater<int>());
+        for (int id : cellScratch) {
+            player->collectWeapon();
+            RemoveWeaponAt(id);
+        }
+
+        // Check enemy collisions, lowest id first
+        cellScratch.clear();
+        for (int id = enemyGrid.first(playerX, playerY); id != -1; id = enemyGrid.next(id)) {
+            cellScratch.push_back(id);
+        }
+        std::sort(cellScratch.begin(), cellScratch.end());
+        size_t defeated = 0;  // power only falls, so the defeated ones come first
+        for (int id : cellScratch) {
+            if (player->getPower() >= 10) {  // Changed from player->getPower() > enemy.getHealth()
+                player->addScore(100);
+                enemies.damage(id, enemies.getHealth(id));
+                player->hitEnemy();  // Decrease player's power by 10
+                defeated++;
+            } else {
+                player->hitEnemy();  // Decrease player's power by 10
+                if (player->getPower() <= 0) {
+                    state = GameState::GAME_OVER;
+                    return;
                 }
             }
         }
 
-        // Remove defeated enemies
-        enemies.erase(std::remove_if(enemies.begin(), enemies.end(),[](const Enemy& enemy) { return !enemy.isAlive(); }), enemies.end());
+        // Remove defeated enemies, highest id first so swap-and-pop never moves a pending one
+        while (defeated > 0) {
+            RemoveEnemyAt(cellScratch[--defeated]);
+        }
+    }
+
+    void RemoveEnemyAt(int id) {
+        int last = (int)enemies.size() - 1;
+        enemyGrid.remove(id);
+        if (id != last) {
+            enemyGrid.rename(last, id);
+        }
+        enemies.removeAt(id);
+    }
+
+    void RemoveWeaponAt(int id) {
+        int last = (int)weapons.size() - 1;
+        weaponGrid.remove(id);
+        if (id != last) {
+            weaponGrid.rename(last, id);
+        }
+        weapons.removeAt(id);
+    }
+
+    // Queues the level in progress for writing: a small header and the SaveState blob, whose
+    // maze walls are one contiguous mask array, so loading decodes straight from the mapped file
+    void SaveGame() {
+        if (!writePlayerFiles || state != GameState::PLAYING || !maze || !player) return;
+        std::vector<uint8_t> payload;
+        SaveState(payload);
+        std::vector<uint8_t> bytes;
+        StateWriter out(bytes);
+        out.put(SAVE_GAME_MAGIC);
+        out.put(SAVE_GAME_VERSION);
+        out.put(HashBytes(payload.data(), payload.size()));
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+        saveWriter.write(SAVE_GAME_PATH, std::move(bytes));
+        savedGameAvailable = true;
+    }
+
+    // Restores the saved level and removes the save, so it can only be resumed once
+    bool ResumeSavedGame() {
+        saveWriter.flush();  // SaveGame only queues the write
+        savedGameAvailable = false;
+        // Hashed and decoded in place, with no copy of the file in between
+        MappedFile file;
+        if (!file.open(SAVE_GAME_PATH)) return false;
+        const uint8_t* bytes = file.data();
+        size_t size = file.size();
+
+        StateReader in(bytes, size);
+        uint32_t magic = 0, version = 0;
+        uint64_t hash = 0;
+        const size_t headerSize = sizeof(magic) + sizeof(version) + sizeof(hash);
+        bool valid = in.get(magic) && magic == SAVE_GAME_MAGIC && in.get(version) && version == SAVE_GAME_VERSION &&
+                     in.get(hash) && hash == HashBytes(bytes + headerSize, size - headerSize);
+        if (!valid || !LoadState(bytes + headerSize, size - headerSize) || state != GameState::PLAYING) {
+            std::cerr << "Saved game " << SAVE_GAME_PATH << " is damaged and was ignored" << std::endl;
+            ExitToMainMenu();
+            return false;
+        }
+        file.close();  // Windows cannot remove a file that is still mapped
+        std::error_code error;
+        std::filesystem::remove(SAVE_GAME_PATH, error);
+
+        tickAccumulator = 0.0f;
+        pendingInput = 0;
+        history.clear();
+        RecycleRecording();
+        recording.start = SESSION_RESUMED;
+        recording.rewindSeconds = options.rewindSeconds;
+        recording.spawnSpacing = options.spawnSpacing;
+        recordingSession = true;
+        sessionTick = 0;
+        ReserveLevelBuffers();
+        return true;
+    }
+
+    // Starts a level from the menus with a fresh seed and records it until it leaves PLAYING
+    void BeginSession(SessionStart start) {
+        RecycleRecording();
+        recording.seed = (uint32_t)GameRandom();
+        recording.character = (uint8_t)selectedCharacter;
+        recording.level = (uint8_t)selectedLevel;
+        recording.start = start;
+        recording.totalScore = totalScore;
+        recording.currentScore = currentScore;
+        recording.rewindSeconds = options.rewindSeconds;
+        recording.spawnSpacing = options.spawnSpacing;
+        StartRecordedSession(recording);
+        ReserveRecording(StateBound());
+        recordingSession = true;
+        sessionTick = 0;
+    }
+
+    // Empties 'recording' for a new session, keeping its input log and handing its keyframes
+    // to the pool, so their buffers carry over
+    void RecycleRecording() {
+        std::vector<std::pair<uint64_t, uint32_t>> inputs;
+        std::vector<SessionKeyframe> keyframes;
+        inputs.swap(recording.inputs);
+        keyframes.swap(recording.keyframes);
+        for (SessionKeyframe& keyframe : keyframes) keyframePool.push_back(std::move(keyframe));
+        inputs.clear();
+        keyframes.clear();
+        recording = SessionRecording();
+        recording.inputs.swap(inputs);
+        recording.keyframes.swap(keyframes);
+    }
+
+    // Sizes the buffers a level's ticks write to once it is set up, so they stay off the heap
+    // after the warm-up, including when a recorded session moves on to a bigger level
+    void ReserveLevelBuffers() {
+        // One cell can hold every enemy or every weapon for CheckCollisions to gather
+        cellScratch.reserve(std::max(enemies.size(), weapons.size()));
+        // Every pending timer can come due on the same tick; rewinding can hold the first
+        // ones back past the warm-up, so they are not left to size themselves
+        firedTimers.reserve(timers.size());
+        dueEnemies.reserve(timers.size());
+        enemies.reserveSteps();
+        size_t cells = (size_t)maze->getWidth() * maze->getHeight();
+        pathScratch.reserve(cells);
+        player->reservePath(cells);
+        size_t stateBytes = StateBound();
+        historyScratch.reserve(stateBytes);
+        history.reserve(stateBytes);
+        if (recordingSession) ReserveRecording(stateBytes);
+    }
+
+    // States only shrink as entities go, apart from the stepped-enemy list and the player's
+    // path, so twice the current size plus the longest path bounds them for the level
+    size_t StateBound() {
+        SaveState(historyScratch);
+        size_t cells = maze ? (size_t)maze->getWidth() * maze->getHeight() : 0;
+        return 2 * historyScratch.size() + cells * sizeof(std::pair<int, int>);
+    }
+
+    // Sizes the input log and the keyframe pool for RECORDING_RESERVE_TICKS of the level that
+    // has just started, whose states stay within 'stateBytes'
+    void ReserveRecording(size_t stateBytes) {
+        size_t keyframeCount = RECORDING_RESERVE_TICKS / KEYFRAME_INTERVAL_TICKS + 1;
+        recording.inputs.reserve(RECORDING_RESERVE_TICKS);
+        recording.keyframes.reserve(keyframeCount);
+        if (keyframePool.size() < keyframeCount) keyframePool.resize(keyframeCount);
+
+        size_t historyBytes = history.serializedBound(stateBytes);
+        size_t budget = RECORDING_RESERVE_BYTES;
+        for (size_t i = keyframePool.size(); i-- > 0 && budget >= stateBytes + historyBytes;) {
+            keyframePool[i].state.reserve(stateBytes);  // taken from the back first
+            keyframePool[i].history.reserve(historyBytes);
+            budget -= stateBytes + historyBytes;
+        }
+    }
+
+    void StartRecordedSession(const SessionRecording& session) {
+        SeedGameRandom(session.seed);
+        selectedCharacter = session.character;
+        selectedLevel = session.level;
+        totalScore = session.totalScore;
+        currentScore = session.currentScore;
+        options.spawnSpacing = session.spawnSpacing;
+        if (session.rewindSeconds != options.rewindSeconds) {
+            options.rewindSeconds = session.rewindSeconds;
+            history = SnapshotHistory(options.rewindSeconds * SIMULATION_TICK_RATE);
+        }
+        history.clear();
+        if (session.start == SESSION_RESUMED && !session.keyframes.empty()) {
+            const std::vector<uint8_t>& saved = session.keyframes.front().state;
+            LoadState(saved.data(), saved.size());
+        } else if (session.start == SESSION_RESTART) {
+            RestartLevel();
+        } else {
+            InitializeGame();
+        }
+    }
+
+    void EndSession() {
+        recordingSession = false;
+        recording.finalTick = sessionTick;
+        recording.finalHash = StateHash();
+        if (!recording.save(options.recordPath)) {
+            std::cerr << "Could not write session recording " << options.recordPath << std::endl;
+        }
+    }
+
+    // Everything the simulation depends on: scores, RNG, the maze and every entity
+    void SaveState(std::vector<uint8_t>& bytes) const {
+        bytes.clear();
+        StateWriter out(bytes);
+        out.put((uint8_t)state);
+        out.put(selectedCharacter);
+        out.put(selectedLevel);
+        out.put(timer);
+        out.put(showPath);
+        out.put(enemiesRelocate);
+        out.put(totalScore);
+        out.put(currentScore);
+        out.put(gameRandomState);
+
+        bool inLevel = maze && player && level;
+        out.put(inLevel);
+        if (!inLevel) return;
+        out.put(maze->getWidth());
+        out.put(maze->getHeight());
+        maze->serialize(out);
+        player->serialize(out);
+        enemies.serialize(out);
+        out.put((uint32_t)weapons.size());
+        for (const Weapon& weapon : weapons) {
+            out.put(weapon.getX());
+            out.put(weapon.getY());
+        }
+        weapons.serializeHandles(out);
+        timers.serialize(out);
+    }
+
+    // Objects that still fit the saved state are reused, so stepping back through the
+    // rewind history does not rebuild the maze every tick
+    bool LoadState(const uint8_t* bytes, size_t size) {
+        StateReader in(bytes, size);
+        uint8_t savedState = 0;
+        bool inLevel = false;
+        int previousCharacter = selectedCharacter;
+        int previousLevel = selectedLevel;
+        in.get(savedState);
+        in.get(selectedCharacter);
+        in.get(selectedLevel);
+        in.get(timer);
+        in.get(showPath);
+        in.get(enemiesRelocate);
+        in.get(totalScore);
+        in.get(currentScore);
+        in.get(gameRandomState);
+        if (!in.get(inLevel)) return false;
+        state = (GameState)savedState;
+        enemies.clear();
+        timers.reset();
+        weapons.clear();
+
+        int width = 0, height = 0;
+        if (inLevel) {
+            in.get(width);
+            in.get(height);
+            if (!in.ok() || width <= 0 || height <= 0) return false;
+        }
+        bool reuse = inLevel && maze && player && level && maze->getWidth() == width && maze->getHeight() == height &&
+                     selectedCharacter == previousCharacter && selectedLevel == previousLevel;
+        if (!reuse) {
+            levelArena.reset();
+            maze = nullptr;
+            player = nullptr;
+            level = nullptr;
+        }
+        if (!inLevel) return in.ok();
+
+        if (!reuse) {
+            level = levelArena.make<Level>(selectedLevel);
+            maze = levelArena.make<Maze>(levelArena, width, height, CellSizeFor(width));
+            maze->loadTextures(startTexture, endTexture);
+            player = levelArena.make<Player>(levelArena, 0, 0, GetPlayerTexture(), maze);
+        }
+        bool wallsChanged = false;
+        if (!maze->deserialize(in, &wallsChanged) || !player->deserialize(in) || !enemies.deserialize(in)) return false;
+        if (wallsChanged) mazeVersion++;
+
+        uint32_t weaponCount = 0;
+        in.get(weaponCount);
+        enemyGrid.reset(width, height);
+        weaponGrid.reset(width, height);
+        for (uint32_t i = 0; i < weaponCount && in.ok(); ++i) {
+            int x = 0, y = 0;
+            in.get(x);
+            in.get(y);
+            if (x < 0 || x >= width || y < 0 || y >= height) return false;
+            weaponGrid.insert(weapons.add(x, y, maze, weaponTexture), x, y);
+        }
+        if (!weapons.deserializeHandles(in) || !timers.deserialize(in)) return false;
+        for (int id = 0; id < (int)enemies.size(); ++id) {
+            enemyGrid.insert(id, enemies.getX(id), enemies.getY(id));
+        }
+        return in.ok() && in.atEnd();
+    }
+
+    uint64_t StateHash() const {
+        std::vector<uint8_t> bytes;
+        SaveState(bytes);
+        return HashBytes(bytes.data(), bytes.size());
+    }
+
+    int CellSizeFor(int mazeSize) const {
+        return std::max(1, std::min((SCREEN_WIDTH - 100) / mazeSize, (SCREEN_HEIGHT - 100) / mazeSize));
     }
 
     void RestartLevel() {
-    delete maze;
+    PROFILE_SCOPE("RestartLevel");
+    levelArena.reset();
+    level = levelArena.make<Level>(selectedLevel);
     int mazeSize = level->getMazeSize();
-    int cellSize = std::min((SCREEN_WIDTH - 100) / mazeSize, (SCREEN_HEIGHT - 100) / mazeSize);
-    maze = new Maze(mazeSize, mazeSize, cellSize);
+    int cellSize = CellSizeFor(mazeSize);
+    maze = levelArena.make<Maze>(levelArena, mazeSize, mazeSize, cellSize);
     maze->generate();
+    mazeVersion++;
     maze->loadTextures(startTexture, endTexture);
 
-    delete player;
-    player = new Player(0, 0, GetPlayerTexture(), maze);
+    player = levelArena.make<Player>(levelArena, 0, 0, GetPlayerTexture(), maze);
     
     enemies.clear();
+    timers.reset();
     weapons.clear();
+    enemyGrid.reset(mazeSize, mazeSize);
+    weaponGrid.reset(mazeSize, mazeSize);
     GenerateWeaponsAndEnemies();
 
     timer = 0.0f;
+    tickAccumulator = 0.0f;
+    pendingInput = 0;
     showPath = false;
     enemiesRelocate = false;
     player->clearPath();
     state = GameState::PLAYING;
+    ReserveLevelBuffers();
     }
 
 
     void InitializeGame() {
-        delete level;
-        level = new Level(selectedLevel);
+        PROFILE_SCOPE("InitializeGame");
+        levelArena.reset();
+        level = levelArena.make<Level>(selectedLevel);
         int mazeSize = level->getMazeSize();
-        int cellSize = std::min((SCREEN_WIDTH - 100) / mazeSize, (SCREEN_HEIGHT - 100) / mazeSize);
+        int cellSize = CellSizeFor(mazeSize);
         
-        delete maze;
-        maze = new Maze(mazeSize, mazeSize, cellSize);
+        maze = levelArena.make<Maze>(levelArena, mazeSize, mazeSize, cellSize);
         maze->generate();
+        mazeVersion++;
         maze->loadTextures(startTexture, endTexture);
         
-        delete player;
-        player = new Player(0, 0, GetPlayerTexture(), maze, totalScore);
+        player = levelArena.make<Player>(levelArena, 0, 0, GetPlayerTexture(), maze, totalScore);
         weapons.clear();
         enemies.clear();
+        timers.reset();
+        enemyGrid.reset(mazeSize, mazeSize);
+        weaponGrid.reset(mazeSize, mazeSize);
         GenerateWeaponsAndEnemies();
         if (player) {
         totalScore = player->getScore();
@@ -880,18 +5602,20 @@ private:
         }
 
         timer = 0.0f;
+        tickAccumulator = 0.0f;
+        pendingInput = 0;
         enemiesRelocate = false;
         showPath = false; // Added line
         state = GameState::PLAYING;
+        ReserveLevelBuffers();
     }
     void ExitToMainMenu() {
-        delete maze;
+        levelArena.reset();
         maze = nullptr;
-        delete player;
         player = nullptr;
-        delete level;
         level = nullptr;
         enemies.clear();
+        timers.reset();
         weapons.clear();
         state = GameState::FIRST_SCREEN;
     }
@@ -917,41 +5641,51 @@ private:
                 numEnemies = maze->getWidth() ;
         }
 
-        for (int i = 0; i < numWeapons; ++i) {
-            int x, y;
-            do {
-                x = rand() % (maze->getWidth() - 2) + 1;
-                y = rand() % (maze->getHeight() - 2) + 1;
-            } while ((x == 0 && y == 0) || (x == maze->getWidth() - 1 && y == maze->getHeight() - 1));
-            weapons.emplace_back(x, y, maze, weaponTexture);
+        // Interior cells only, each used once; enemies also keep their distance from the entrance
+        int width = maze->getWidth();
+        int height = maze->getHeight();
+        auto interior = [&](int x, int y) { return x > 0 && y > 0 && x < width - 1 && y < height - 1; };
+        int x, y;
+        spawns.prepare(*maze, 0, 0, 1, interior);
+        for (int i = 0; i < numWeapons && spawns.take(x, y); ++i) {
+            weaponGrid.insert(weapons.add(x, y, maze, weaponTexture), x, y);
         }
-
-        for (int i = 0; i < numEnemies; ++i) {
-            int x, y;
-            do {
-                x = rand() % (maze->getWidth() - 2) + 1;
-                y = rand() % (maze->getHeight() - 2) + 1;
-            } while ((x == 0 && y == 0) || (x == maze->getWidth() - 1 && y == maze->getHeight() - 1));
-            enemies.emplace_back(x, y, maze, enemyTexture);
+        enemies.setWanderSeed((uint32_t)GameRandom());
+        spawns.prepare(*maze, 0, 0, ENEMY_SPAWN_MIN_DISTANCE, [&](int x, int y) {
+            return interior(x, y) && weaponGrid.empty(x, y);
+        });
+        for (int i = 0; i < numEnemies && spawns.take(x, y, options.spawnSpacing); ++i) {
+            int id = enemies.add(x, y);
+            enemyGrid.insert(id, x, y);
+            timers.schedule(ENEMY_MOVE_TICKS, TIMER_ENEMY_MOVE, enemies.handleAt(id));
         }
     }
     void CheckAndRelocateNearbyEnemies() {
         if(enemiesRelocate){return ;}
-        for (auto& enemy : enemies) {
-            int enemyX = enemy.getX();
-            int enemyY = enemy.getY();
-            int playerX = player->getX();
-            int playerY = player->getY();
-
-            if (abs(enemyX - playerX) <= 1 && abs(enemyY - playerY) <= 1) {
-                // Enemy is too close to the player, relocate it
+        int playerX = player->getX();
+        int playerY = player->getY();
+        if (enemyGrid.nearest(playerX, playerY, 1) == -1) {
+            enemiesRelocate = true;
+            return;
+        }
+
+        // Enemies too close to the player, gathered first since relocating edits the grid
+        cellScratch.clear();
+        enemyGrid.forEachInRadius(playerX, playerY, 1, [this](int id, int, int) { cellScratch.push_back(id); });
+        std::sort(cellScratch.begin(), cellScratch.end());  // by id, not list order, for --seek
+
+        if (!cellScratch.empty()) {
+            // Somewhere free that the player can reach but not right away
+            int exitX = maze->getWidth() - 1;
+            int exitY = maze->getHeight() - 1;
+            spawns.prepare(*maze, playerX, playerY, ENEMY_SPAWN_MIN_DISTANCE, [&](int x, int y) {
+                return !(x == 0 && y == 0) && !(x == exitX && y == exitY) && enemyGrid.empty(x, y);
+            });
+            for (int id : cellScratch) {
                 int newX, newY;
-                do {
-                    newX = rand() % maze->getWidth();
-                    newY = rand() % maze->getHeight();
-                } while ((newX == 0 && newY == 0) || (newX == maze->getWidth() - 1 && newY == maze->getHeight() - 1) || (newX == playerX && newY == playerY));
-                enemy.setX(newX);
-                enemy.setY(newY);
+                if (!spawns.take(newX, newY)) break;
+                enemies.setPosition(id, newX, newY);
+                enemyGrid.move(id, newX, newY);
             }
         }
         enemiesRelocate=true;
@@ -980,6 +5714,7 @@ private:
     }
 
     void SaveScores() {
+        if (!writePlayerFiles) return;  // simulated runs must not overwrite the player's scores
         std::ofstream scoreFile("highscores.txt");
         if (scoreFile.is_open()) {
             for (int score : highScores) {
@@ -1012,14 +5747,119 @@ private:
     };
     int Game::currentScore = 0;
 
-int main() {
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Star Wars Maze");
-    SetTargetFPS(60);
+LaunchOptions ParseLaunchOptions(int argc, char** argv) {
+    LaunchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threaded-sim") {
+            options.threadedSimulation = true;
+        } else if (arg == "--bench-threaded") {
+            options.threadedSimulation = true;
+            options.benchThreaded = true;
+        } else if (arg == "--sim-hz" && i + 1 < argc) {
+            options.simulationHz = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--fps" && i + 1 < argc) {
+            options.renderFps = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--levels" && i + 1 < argc) {
+            options.headlessLevels = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--max-ticks" && i + 1 < argc) {
+            options.maxTicks = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--level" && i + 1 < argc) {
+            options.startLevel = std::min(3, std::max(1, atoi(argv[++i])));
+        } else if (arg == "--script" && i + 1 < argc) {
+            options.scriptPath = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--export" && i + 1 < argc) {
+            options.exportPath = argv[++i];
+            options.headless = true;
+        } else if (arg == "--maze-size" && i + 1 < argc) {
+            options.exportMazeSize = std::min(MAX_MAZE_SIZE, std::max(3, atoi(argv[++i])));
+        } else if (arg == "--cell-px" && i + 1 < argc) {
+            options.exportCellPx = atoi(argv[++i]);
+        } else if (arg == "--wall-px" && i + 1 < argc) {
+            options.exportWallPx = atoi(argv[++i]);
+        } else if (arg == "--spawn-spacing" && i + 1 < argc) {
+            options.spawnSpacing = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--no-path") {
+            options.exportSolution = false;
+        } else if (arg == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replayPath = argv[++i];
+            options.headless = true;
+        } else if (arg == "--rewind-seconds" && i + 1 < argc) {
+            options.rewindSeconds = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--seek" && i + 1 < argc) {
+            options.seekTick = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+            options.traceAtLaunch = true;
+#ifndef MAZE_PROFILER
+            std::cerr << "--trace needs a build with MAZE_PROFILER enabled" << std::endl;
+#endif
+        } else if (arg == "--frame-bench" && i + 1 < argc) {
+            options.frameBenchPath = argv[++i];
+        } else if (arg == "--bench-json" && i + 1 < argc) {
+            options.benchJsonPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.benchBaselinePath = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            options.benchThresholdPercent = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--assert-no-alloc") {
+            options.assertNoAllocations = true;
+#ifndef MAZE_ALLOC_TRACKING
+            std::cerr << "--assert-no-alloc needs a build with MAZE_ALLOC_TRACKING enabled" << std::endl;
+#endif
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+        }
+    }
+    return options;
+}
+
+#ifdef MAZE_BENCHMARKS
 
-    Game game;
-    game.Run();
+// maze_bench: the micro-benchmarks, without a window or audio
+int main(int argc, char** argv) {
+    LaunchOptions options = ParseLaunchOptions(argc, argv);
+    options.headless = true;
+    if (options.seed == 0) options.seed = 1;  // same mazes every run, so results compare
+    Game game(options);
+    return game.RunBenchmarks();
+}
+
+#else
+
+int main(int argc, char** argv) {
+    LaunchOptions options = ParseLaunchOptions(argc, argv);
+
+    if (options.headless) {
+        Game game(options);
+        if (!options.replayPath.empty()) return game.RunReplay();
+        return options.exportPath.empty() ? game.RunHeadless() : game.RunExport();
+    }
+
+    bool frameBench = !options.frameBenchPath.empty();
+    if (frameBench) SetConfigFlags(FLAG_WINDOW_HIDDEN);  // frames go to a render texture, never to the screen
+    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Star Wars Maze");
+    SetTargetFPS(frameBench ? 0 : options.renderFps);
+
+    Game game(options);
+    if (frameBench) {
+        int result = game.RunFrameBenchmark();
+        CloseWindow();
+        return result;
+    } else if (options.benchThreaded) {
+        game.RunThreadedBenchmark();
+    } else {
+        game.Run();
+    }
 
     CloseWindow();
     return 0;
 }
 
+#endif
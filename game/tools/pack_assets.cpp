@@ -0,0 +1,89 @@
+// pack_assets OUTPUT ROOT FILE...
+// Packs the given files into one asset archive (see asset_pack.h). Each entry is named by
+// its path relative to ROOT, which is the path the game asks for ("src/enemy.png").
+// The archive is written to OUTPUT.tmp and renamed, so a failed run never leaves half a file.
+#include "../asset_pack.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct PackedFile {
+    std::string name;
+    std::vector<char> bytes;
+};
+
+static size_t AlignUp(size_t value) {
+    return (value + ASSET_PACK_ALIGNMENT - 1) & ~(ASSET_PACK_ALIGNMENT - 1);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: pack_assets OUTPUT ROOT FILE..." << std::endl;
+        return 1;
+    }
+    fs::path output = argv[1];
+    fs::path root = argv[2];
+
+    std::vector<PackedFile> files;
+    for (int i = 3; i < argc; ++i) {
+        fs::path path = argv[i];
+        PackedFile file;
+        file.name = fs::relative(path, root).generic_string();
+        if (file.name.size() >= ASSET_PACK_NAME_SIZE) {
+            std::cerr << "Asset name too long for the archive: " << file.name << std::endl;
+            return 1;
+        }
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot read " << path.string() << std::endl;
+            return 1;
+        }
+        file.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        files.push_back(std::move(file));
+    }
+
+    AssetPackHeader header = { ASSET_PACK_MAGIC, ASSET_PACK_VERSION, (uint32_t)files.size(), 0 };
+    std::vector<AssetPackEntry> entries(files.size());
+    size_t offset = AlignUp(sizeof(header) + entries.size() * sizeof(AssetPackEntry));
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::memset(&entries[i], 0, sizeof(AssetPackEntry));
+        std::memcpy(entries[i].name, files[i].name.c_str(), files[i].name.size());
+        entries[i].offset = offset;
+        entries[i].size = files[i].bytes.size();
+        offset = AlignUp(offset + files[i].bytes.size());
+    }
+
+    fs::path temporary = output;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)entries.data(), entries.size() * sizeof(AssetPackEntry));
+        for (size_t i = 0; i < files.size(); ++i) {
+            // Pad up to the entry's aligned offset
+            std::vector<char> padding((size_t)entries[i].offset - (size_t)out.tellp(), 0);
+            out.write(padding.data(), padding.size());
+            out.write(files[i].bytes.data(), files[i].bytes.size());
+        }
+        if (!out) {
+            std::cerr << "Cannot write " << temporary.string() << std::endl;
+            return 1;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporary, output, error);
+    if (error) {
+        std::cerr << "Cannot replace " << output.string() << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Packed " << files.size() << " assets into " << output.string() << std::endl;
+    return 0;
+}